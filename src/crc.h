@@ -0,0 +1,270 @@
+//***************************************************************************
+//
+//  File Name :		crc.h
+//
+//  Project :		Library for the Atmel 8 bit AVR MCU
+//
+//  Purpose :		Incremental 16 bit CRC with selectable polynomial and method
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013-2016 Andy Burgess
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//  Revisions :
+//
+//      see rcs below
+//
+//***************************************************************************
+
+
+#ifndef CRC_H_
+#define CRC_H_
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+
+//! \brief CRC-16/MODBUS: polynomial 0x8005 reflected, initial value 0xFFFF
+//! \details The same as avr-libc's _crc16_update() started at 0xFFFF.  The
+//! CRC is sent low byte first, and a frame including its CRC checks to zero.
+struct CrcModbus
+{
+	static const bool reflected = true;
+	static const uint16_t poly = 0xa001;
+	static const uint16_t initial = 0xffff;
+};
+
+
+//! \brief CRC-CCITT: polynomial 0x1021 reflected, initial value 0xFFFF
+//! \details The same as avr-libc's _crc_ccitt_update(), as used by HDLC,
+//! PPP and IrDA.
+struct CrcCcitt
+{
+	static const bool reflected = true;
+	static const uint16_t poly = 0x8408;
+	static const uint16_t initial = 0xffff;
+};
+
+
+//! \brief CRC-16/XMODEM: polynomial 0x1021, initial value zero
+//! \details The same as avr-libc's _crc_xmodem_update().  The CRC is sent
+//! high byte first.
+struct CrcXmodem
+{
+	static const bool reflected = false;
+	static const uint16_t poly = 0x1021;
+	static const uint16_t initial = 0;
+};
+
+
+// works out the table entries at compile time
+template <class TPOLY>
+struct CrcMath
+{
+	static constexpr uint16_t step (uint16_t crc)
+	{
+		return TPOLY::reflected ?
+			((crc & 1) ? (crc >> 1) ^ TPOLY::poly : crc >> 1) :
+			((crc & 0x8000) ? uint16_t (crc << 1) ^ TPOLY::poly : uint16_t (crc << 1));
+	}
+
+	static constexpr uint16_t steps (uint16_t crc, uint8_t bits)
+	{
+		return bits ? steps (step (crc), bits - 1) : crc;
+	}
+
+	// the CRC of an index of the given number of bits
+	static constexpr uint16_t entry (uint16_t index, uint8_t bits)
+	{
+		return steps (TPOLY::reflected ? index : uint16_t (index << (16 - bits)), bits);
+	}
+};
+
+
+template <uint16_t... I>
+struct CrcIndices { };
+
+template <uint16_t N, uint16_t... I>
+struct CrcMakeIndices : CrcMakeIndices<N - 1, N - 1, I...> { };
+
+template <uint16_t... I>
+struct CrcMakeIndices<0, I...> { typedef CrcIndices<I...> type; };
+
+
+// a table in flash of the CRC of every value of BITS bits
+template <class TPOLY, uint8_t BITS, class TINDICES = typename CrcMakeIndices<1 << BITS>::type>
+struct CrcTableData;
+
+template <class TPOLY, uint8_t BITS, uint16_t... I>
+struct CrcTableData<TPOLY, BITS, CrcIndices<I...> >
+{
+	static const uint16_t entries [sizeof... (I)];
+};
+
+template <class TPOLY, uint8_t BITS, uint16_t... I>
+const uint16_t CrcTableData<TPOLY, BITS, CrcIndices<I...> >::entries [sizeof... (I)] PROGMEM =
+{
+	CrcMath<TPOLY>::entry (I, BITS)...
+};
+
+
+//! \brief Looks the CRC up a byte at a time in a 256 entry table in flash
+//! \details The fastest method, at the cost of 512 bytes of flash for each
+//! polynomial used.
+struct CrcTable
+{
+	template <class TPOLY>
+	__attribute__ ((always_inline)) static inline uint16_t update (uint16_t crc, uint8_t data)
+	{
+		const uint16_t * table = CrcTableData<TPOLY, 8>::entries;
+
+		if (TPOLY::reflected)
+			return (crc >> 8) ^ pgm_read_word (&table[uint8_t (crc ^ data)]);
+		return (crc << 8) ^ pgm_read_word (&table[uint8_t (crc >> 8) ^ data]);
+	}
+};
+
+
+//! \brief Looks the CRC up four bits at a time in a 16 entry table in flash
+//! \details Takes about twice as long as CrcTable with a 32 byte table.
+struct CrcNibble
+{
+	template <class TPOLY>
+	__attribute__ ((always_inline)) static inline uint16_t update (uint16_t crc, uint8_t data)
+	{
+		const uint16_t * table = CrcTableData<TPOLY, 4>::entries;
+
+		if (TPOLY::reflected)
+		{
+			crc = (crc >> 4) ^ pgm_read_word (&table[(crc ^ data) & 0x0f]);
+			return (crc >> 4) ^ pgm_read_word (&table[(crc ^ (data >> 4)) & 0x0f]);
+		}
+		crc = (crc << 4) ^ pgm_read_word (&table[(uint8_t (crc >> 12) ^ (data >> 4)) & 0x0f]);
+		return (crc << 4) ^ pgm_read_word (&table[(uint8_t (crc >> 12) ^ data) & 0x0f]);
+	}
+};
+
+
+//! \brief Works the CRC out a bit at a time
+//! \details The smallest and slowest method, with no table.
+struct CrcBitwise
+{
+	template <class TPOLY>
+	__attribute__ ((always_inline)) static inline uint16_t update (uint16_t crc, uint8_t data)
+	{
+		if (TPOLY::reflected)
+			crc ^= data;
+		else
+			crc ^= uint16_t (data) << 8;
+
+		for (uint8_t i = 0; i < 8; i++)
+			crc = CrcMath<TPOLY>::step (crc);
+		return crc;
+	}
+};
+
+
+//! \brief An incremental 16 bit CRC
+//! \details Keeps a running CRC that can be added to a byte at a time, so it
+//! can be updated in an interrupt as each byte arrives or leaves and is ready
+//! as soon as the last byte is through.  The table sizes are exact; the
+//! cycles per byte are estimates from the shape of the code, not measured:
+//! \li CrcTable - about 20 cycles, 512 bytes of table
+//! \li CrcNibble - about 45 cycles, 32 bytes of table
+//! \li CrcBitwise - about 90 cycles, no table
+//! \code
+//! Crc16<CrcModbus> crc;
+//! crc.update (frame, length);
+//! if (crc.value() == 0) ...
+//! \endcode
+//! Any of these can be given to Uart as the rxCrc or txCrc option.
+//! \tparam TPOLY The CRC, CrcModbus, CrcCcitt or CrcXmodem
+//! \tparam TMETHOD How it is calculated, CrcTable, CrcNibble or CrcBitwise
+template <class TPOLY, class TMETHOD = CrcNibble>
+class Crc16
+{
+private:
+	uint16_t crc;
+
+public:
+	static const bool enabled = true;
+
+	//! \brief Initialises a new instance of the Crc16 class
+	inline Crc16 () __attribute__((always_inline)) : crc(TPOLY::initial) { }
+
+
+	//! \brief Starts a new CRC
+	inline void reset () __attribute__((always_inline))
+	{
+		crc = TPOLY::initial;
+	}
+
+
+	//! \brief Adds a byte to the CRC
+	inline void update (uint8_t data) __attribute__((always_inline))
+	{
+		crc = TMETHOD::template update<TPOLY> (crc, data);
+	}
+
+
+	//! \brief Adds a block of bytes to the CRC
+	//! \param data Pointer to the bytes
+	//! \param count The number of bytes
+	void update (const uint8_t * data, uint16_t count)
+	{
+		while (count--)
+			update (*data++);
+	}
+
+
+	//! \brief Gets the CRC of the bytes so far
+	inline uint16_t value () __attribute__((always_inline))
+	{
+		return crc;
+	}
+
+
+	//! \brief Calculates the CRC of a block of bytes
+	//! \param data Pointer to the bytes
+	//! \param count The number of bytes
+	static uint16_t compute (const uint8_t * data, uint16_t count)
+	{
+		Crc16 result;
+		result.update (data, count);
+		return result.value();
+	}
+};
+
+
+//! \brief Stands in for Crc16 in UartOptions when no CRC is kept
+//! \details Every method does nothing so the calculation is removed by the
+//! compiler.
+struct NoCrc
+{
+	static const bool enabled = false;
+
+	inline void reset () __attribute__((always_inline)) { }
+	inline void update (uint8_t) __attribute__((always_inline)) { }
+	inline uint16_t value () __attribute__((always_inline)) { return 0; }
+};
+
+
+#endif /* CRC_H_ */
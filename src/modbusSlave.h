@@ -0,0 +1,487 @@
+//***************************************************************************
+//
+//  File Name :		modbusSlave.h
+//
+//  Project :		Library for the Atmel 8 bit AVR MCU
+//
+//  Purpose :		Modbus RTU slave driven by the UART and timer interrupts
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013-2016 Andy Burgess
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//  Revisions :
+//
+//      see rcs below
+//
+//***************************************************************************
+
+
+#ifndef MODBUSSLAVE_H_
+#define MODBUSSLAVE_H_
+
+#include <uart.h>
+#include <crc.h>
+#include <timer8.h>
+#include <timer16.h>
+// the timer headers leave the SFR macros as plain addresses
+#include <avr/io.h>
+
+
+//! \brief The Modbus function codes handled by ModbusSlave
+enum modbus_function_t
+{
+	modbusReadHolding = 0x03,		//!< read holding registers
+	modbusReadInput = 0x04,			//!< read input registers
+	modbusWriteSingle = 0x06,		//!< write single register
+	modbusWriteMultiple = 0x10		//!< write multiple registers
+};
+
+
+//! \brief The Modbus exception codes returned by ModbusSlave
+enum modbus_exception_t
+{
+	modbusIllegalFunction = 0x01,	//!< the function code is not supported
+	modbusIllegalAddress = 0x02,	//!< the registers are outside the map
+	modbusIllegalValue = 0x03		//!< the quantity or byte count is wrong
+};
+
+
+//! \brief Called after the master has written holding registers
+//! \param first The index of the first register written
+//! \param count The number of registers written
+typedef void (*modbus_write_t) (uint16_t first, uint8_t count);
+
+
+//! \brief The 1024 prescaler code for an 8 bit timer
+//! \details Timer 2 has its own set of prescalers, see clockModeT2_t
+template <class TTIMER8>
+struct ModbusPre1024 { static const uint8_t mode = ClkPre1024; };
+
+#ifdef TCCR2A
+template <>
+struct ModbusPre1024<TIMER2> { static const uint8_t mode = ClkT2Pre1024; };
+#endif
+
+
+//! \brief Runs a timer as the Modbus silent interval detector
+//! \details Specialised below for Timer8 and Timer16.  The timer counts in
+//! CTC mode and its compare A interrupt marks the end of a frame.
+template <class TTIMER>
+class ModbusSilence;
+
+
+//! \brief A 16 bit timer as the silent interval detector
+//! \details The timer runs from F_CPU/8, so any rate from 1200 baud
+//! upwards fits at 16MHz with 0.5us resolution.
+template <class TTIMER16>
+class ModbusSilence<Timer16<TTIMER16> >
+{
+private:
+	Timer16<TTIMER16> timer;
+
+public:
+	template <uint32_t FCPU, uint32_t MICROS>
+	__attribute__ ((always_inline)) inline void init ()
+	{
+		static const uint32_t ticks = FCPU / 8000 * MICROS / 1000;
+		static_assert(ticks > 0 && ticks <= 65536, "Modbus silent interval does not fit the timer");
+
+		timer.disableOutputMatchAInt();
+		timer.setWavegenMode (Wgen16CtcO);
+		timer.writeCompareA (ticks - 1);
+		timer.setClockMode (ClkPre8);
+	}
+
+	inline void restart () __attribute__((always_inline))
+	{
+		timer.write (0);
+		timer.clearOutputMatchA();
+		timer.enableOutputMatchAInt();
+	}
+
+	inline void stop () __attribute__((always_inline)) { timer.disableOutputMatchAInt(); }
+};
+
+
+//! \brief An 8 bit timer as the silent interval detector
+//! \details The timer runs from F_CPU/1024, 64us per count at 16MHz, which
+//! is fine enough for the 1.75ms interval and covers 2400 baud upwards.
+template <class TTIMER8>
+class ModbusSilence<Timer8<TTIMER8> >
+{
+private:
+	Timer8<TTIMER8> timer;
+
+public:
+	template <uint32_t FCPU, uint32_t MICROS>
+	__attribute__ ((always_inline)) inline void init ()
+	{
+		static const uint32_t ticks = (FCPU / 1024 * MICROS + 999999) / 1000000;
+		static_assert(ticks > 0 && ticks <= 256, "Modbus silent interval does not fit the timer");
+
+		timer.disableOutputMatchAInt();
+		timer.setWavegenMode (Wgen8CtcO);
+		timer.writeCompareA (ticks - 1);
+		timer.setClockMode (ModbusPre1024<TTIMER8>::mode);
+	}
+
+	inline void restart () __attribute__((always_inline))
+	{
+		timer.write (0);
+		timer.clearOutputMatchA();
+		timer.enableOutputMatchAInt();
+	}
+
+	inline void stop () __attribute__((always_inline)) { timer.disableOutputMatchAInt(); }
+};
+
+
+//! \brief A Modbus RTU slave
+//! \details The whole protocol runs in three interrupts, so the main code
+//! only sees the register map change:
+//! \li each received byte is stored, added to the CRC and restarts the
+//! silence timer
+//! \li when the line has been quiet for 3.5 characters (a fixed 1.75ms
+//! above 19200 baud) the timer interrupt checks the CRC, which has already
+//! been worked out, and the slave address, then carries out the request and
+//! starts the response
+//! \li the transmit interrupt sends the response
+//!
+//! Frames for other slaves are dropped as soon as the silence is seen, so
+//! frames can follow each other with only the minimum gap.
+//!
+//! The register maps are the application's own arrays and are never copied.
+//! Read responses are sent straight from them, with the CRC calculated as
+//! each byte goes out, so any number of registers can be read whatever the
+//! size of the frame buffer.  FRAMESIZE only limits the requests, a write of
+//! n registers needing 9 + 2n bytes; longer frames are ignored.
+//!
+//! The functions supported are read holding registers (3), read input
+//! registers (4), write single register (6) and write multiple registers
+//! (16).  Others get the illegal function exception.  Broadcast writes are
+//! carried out without a reply.  As the registers are read and written by
+//! the timer interrupt, the main code should update a register that is
+//! wider than a byte in an ATOMIC_BLOCK.
+//!
+//! The character format is left as set by Uart::init(); Modbus asks for
+//! even parity, or two stop bits without it.  For RS485 give the options a
+//! dePin and also call txCompleteIsr() from the USARTn_TX_vect.
+//! \code
+//! uint16_t holding [10];
+//! ModbusSlave<UART0, Timer16<TIMER1> > modbus;
+//! ISR(USART0_RX_vect) { modbus.rxCompleteIsr(); }
+//! ISR(USART0_UDRE_vect) { modbus.dataEmptyIsr(); }
+//! ISR(TIMER1_COMPA_vect) { modbus.silenceIsr(); }
+//!
+//! modbus.init<F_CPU, 19200>(17);
+//! modbus.setHoldingRegisters (holding, 10);
+//! \endcode
+//! \tparam TUART One of the predefined objects UART_0, UART_1, UART_2 or UART_3
+//! \tparam TTIMER The silence timer, Timer8<TIMER0>, Timer8<TIMER2> or one of
+//! the Timer16 objects
+//! \tparam FRAMESIZE The size of the receive buffer, up to 255
+//! \tparam TOPTIONS A structure derived from UartOptions
+//! \tparam TMETHOD How the CRC is calculated, see Crc16
+template <class TUART, class TTIMER, uint8_t FRAMESIZE = 64, class TOPTIONS = UartOptions, class TMETHOD = CrcNibble>
+class ModbusSlave : public Uart<TUART, 0, 0, TOPTIONS>
+{
+private:
+	static_assert(FRAMESIZE >= 8, "The Modbus frame buffer must hold at least 8 bytes");
+
+	static const uint8_t stateIdle = 0;			// receiving
+	static const uint8_t stateSend = 1;			// request accepted, response being sent
+	static const uint8_t stateSent = 2;			// waiting for the line to go quiet
+
+	ModbusSilence<TTIMER> silence;
+	uint8_t frame [FRAMESIZE];
+	uint8_t count;								// bytes received
+	Crc16<CrcModbus, TMETHOD> crc;				// CRC of the bytes received or sent
+	bool error;									// the frame is damaged or too long
+	volatile uint8_t state;
+	uint8_t slaveAddress;
+
+	uint16_t * holding;
+	uint16_t holdingCount;
+	const uint16_t * input;
+	uint16_t inputCount;
+	modbus_write_t written;
+
+	// the response is frame[0..txHeader), then txData bytes of registers
+	// high byte first, then the CRC
+	uint8_t txHeader;
+	const uint16_t * txRegisters;
+	uint8_t txData;
+	uint8_t txPos;
+
+public:
+	//! \brief Initialises a new instance of the ModbusSlave class
+	inline ModbusSlave () __attribute__((always_inline)) :
+		count(0), error(false), state(stateIdle), slaveAddress(0),
+		holding(0), holdingCount(0), input(0), inputCount(0), written(0) { }
+
+
+	//! \brief Initialises the UART and the silence timer and starts receiving
+	//! \tparam FCPU The CPU clock frequency, normally F_CPU
+	//! \tparam RATE The baudrate
+	//! \param address The slave address, 1 to 247
+	template <uint32_t FCPU, uint32_t RATE>
+	__attribute__ ((always_inline)) inline void init (uint8_t address)
+	{
+		// 3.5 characters of 11 bits, or the fixed interval above 19200 baud
+		static const uint32_t micros = RATE > 19200 ? 1750 : (35 * 11 * 100000UL + RATE - 1) / RATE;
+
+		Uart<TUART, 0, 0, TOPTIONS>::init();
+		this->template setBaud<FCPU, RATE>();
+		silence.template init<FCPU, micros>();
+		slaveAddress = address;
+		this->enableRxInt();
+	}
+
+
+	//! \brief Sets the address the slave answers to
+	//! \param address The slave address, 1 to 247
+	inline void setSlaveAddress (uint8_t address) __attribute__((always_inline))
+	{
+		slaveAddress = address;
+	}
+
+
+	//! \brief Sets the holding registers, read by function 3 and written by
+	//! functions 6 and 16
+	//! \param registers The application's register array, which is used in place
+	//! \param number The number of registers in the array
+	inline void setHoldingRegisters (uint16_t * registers, uint16_t number) __attribute__((always_inline))
+	{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			holding = registers;
+			holdingCount = number;
+		}
+	}
+
+
+	//! \brief Sets the input registers, read by function 4
+	//! \param registers The application's register array, which is used in place
+	//! \param number The number of registers in the array
+	inline void setInputRegisters (const uint16_t * registers, uint16_t number) __attribute__((always_inline))
+	{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			input = registers;
+			inputCount = number;
+		}
+	}
+
+
+	//! \brief Sets a function to be called after holding registers are written
+	//! \details It is called from silenceIsr() before the response is sent,
+	//! so it should be short.
+	//! \param callback The function, or 0 for none
+	inline void setWriteCallback (modbus_write_t callback) __attribute__((always_inline))
+	{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			written = callback;
+		}
+	}
+
+
+	//! \brief Receive complete interrupt handler
+	//! \details Call from the USARTn_RX_vect interrupt routine.  Replaces
+	//! Uart::rxCompleteIsr().
+	inline void rxCompleteIsr () __attribute__((always_inline))
+	{
+		uint8_t status = *psfr8_t (TUART::crsax);
+		uint8_t data = *psfr8_t (TUART::datax);
+
+		silence.restart();
+
+		// the master may not start a new frame until the reply is over, so
+		// this is noise or the reply echoed back
+		if (state != stateIdle)
+			return;
+
+		if (status & (_BV(FE0) | _BV(DOR0) | _BV(UPE0)))
+			error = true;
+
+		if (count < FRAMESIZE)
+		{
+			frame[count++] = data;
+			crc.update (data);
+		}
+		else
+			error = true;
+	}
+
+
+	//! \brief Silence timer compare match A interrupt handler
+	//! \details Call from the TIMERn_COMPA_vect interrupt routine of the timer.
+	inline void silenceIsr () __attribute__((always_inline))
+	{
+		silence.stop();
+
+		// the CRC of a frame including its own CRC is zero
+		uint8_t length = count;
+		bool valid = !error && length >= 4 && crc.value() == 0;
+
+		count = 0;
+		crc.reset();
+		error = false;
+
+		if (state == stateIdle)
+		{
+			if (valid && (frame[0] == slaveAddress || frame[0] == 0))
+				process (length);
+		}
+		else if (state == stateSent)
+			state = stateIdle;
+	}
+
+
+	//! \brief Data register empty interrupt handler
+	//! \details Call from the USARTn_UDRE_vect interrupt routine.  Replaces
+	//! Uart::dataEmptyIsr().
+	inline void dataEmptyIsr () __attribute__((always_inline))
+	{
+		uint8_t end = txHeader + txData;
+		uint8_t data;
+
+		if (txPos < txHeader)
+			data = frame[txPos];
+		else if (txPos < end)
+		{
+			uint8_t i = txPos - txHeader;
+			uint16_t value = txRegisters[i >> 1];
+			data = (i & 1) ? uint8_t (value) : uint8_t (value >> 8);
+		}
+		else if (txPos == end)
+			data = uint8_t (crc.value());
+		else
+		{
+			// the last byte; wait for the line to go quiet before receiving
+			this->write (uint8_t (crc.value() >> 8));
+			this->disableTxEmptyInt();
+			crc.reset();
+			state = stateSent;
+			silence.restart();
+			return;
+		}
+
+		if (txPos < end)
+			crc.update (data);
+		txPos++;
+		this->write (data);
+	}
+
+
+private:
+	// carries out the request in the frame buffer and starts the response
+	void process (uint8_t length)
+	{
+		uint8_t function = frame[1];
+		uint16_t first = (frame[2] << 8) | frame[3];
+		uint16_t quantity = (frame[4] << 8) | frame[5];
+		uint8_t exception = 0;
+
+		txHeader = 0;
+		txData = 0;
+
+		switch (function)
+		{
+			case modbusReadHolding:
+			case modbusReadInput:
+			{
+				const uint16_t * map = function == modbusReadHolding ? holding : input;
+				uint16_t size = function == modbusReadHolding ? holdingCount : inputCount;
+
+				if (length != 8 || frame[0] == 0)
+					return;
+				if (quantity == 0 || quantity > 125)
+					exception = modbusIllegalValue;
+				else if (first >= size || quantity > size - first)
+					exception = modbusIllegalAddress;
+				else
+				{
+					frame[2] = quantity * 2;
+					txHeader = 3;
+					txRegisters = map + first;
+					txData = quantity * 2;
+				}
+				break;
+			}
+
+			case modbusWriteSingle:
+				if (length != 8)
+					return;
+				if (first >= holdingCount)
+					exception = modbusIllegalAddress;
+				else
+				{
+					holding[first] = quantity;
+					if (written)
+						written (first, 1);
+					txHeader = 6;
+				}
+				break;
+
+			case modbusWriteMultiple:
+				if (length < 9 || length != 9 + frame[6])
+					return;
+				if (quantity == 0 || quantity > 123 || frame[6] != quantity * 2)
+					exception = modbusIllegalValue;
+				else if (first >= holdingCount || quantity > holdingCount - first)
+					exception = modbusIllegalAddress;
+				else
+				{
+					const uint8_t * data = frame + 7;
+					for (uint8_t i = 0; i < quantity; i++, data += 2)
+						holding[first + i] = (data[0] << 8) | data[1];
+					if (written)
+						written (first, quantity);
+					txHeader = 6;
+				}
+				break;
+
+			default:
+				exception = modbusIllegalFunction;
+				break;
+		}
+
+		// broadcasts are never answered
+		if (frame[0] == 0)
+			return;
+
+		if (exception)
+		{
+			frame[1] = function | 0x80;
+			frame[2] = exception;
+			txHeader = 3;
+		}
+
+		txPos = 0;
+		state = stateSend;
+		this->enableTxEmptyInt();
+	}
+};
+
+
+#endif /* MODBUSSLAVE_H_ */
@@ -0,0 +1,219 @@
+//***************************************************************************
+//
+//  File Name :		ringbuffer.h
+//
+//  Project :		Library for the Atmel 8 bit AVR MCU
+//
+//  Purpose :		A lock free byte queue shared between an interrupt
+//					routine and the main line code
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013-2016 Andy Burgess
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//  Revisions :
+//
+//      see rcs below
+//
+//***************************************************************************
+
+
+#ifndef RINGBUFFER_H_
+#define RINGBUFFER_H_
+
+#include <stdint.h>
+
+
+//! \brief A bitmap holding one tag bit for each slot of a RingBuffer
+//! \details Costs one byte for every eight slots.  Only the producer writes
+//! the bitmap, and only for the slot it is about to publish, so the consumer
+//! can read it without locking.
+template <uint8_t SIZE, bool TAGGED>
+class RingBufferTags
+{
+private:
+	volatile uint8_t bits [(SIZE + 7) / 8];
+
+protected:
+	inline void setTag (uint8_t index, bool tag) __attribute__((always_inline))
+	{
+		uint8_t mask = 1 << (index & 7);
+		if (tag)
+			bits[index >> 3] |= mask;
+		else
+			bits[index >> 3] &= ~mask;
+	}
+
+	inline bool getTag (uint8_t index) __attribute__((always_inline))
+	{
+		return bits[index >> 3] & (1 << (index & 7));
+	}
+};
+
+
+//! \brief A special case for an untagged queue
+//! \details Holds nothing; as an empty base class it adds no RAM.
+template <uint8_t SIZE>
+class RingBufferTags<SIZE, false>
+{
+protected:
+	inline void setTag (uint8_t, bool) __attribute__((always_inline)) { }
+	inline bool getTag (uint8_t) __attribute__((always_inline)) { return false; }
+};
+
+
+//! \brief A single producer, single consumer byte queue
+//! \details The queue is safe to share between one interrupt routine and
+//! the main line code without disabling interrupts.  The head index is only
+//! ever written by the producer and the tail index only by the consumer.  Both
+//! are free running eight bit counters, so the number of bytes held is simply
+//! their difference and no slot needs to be sacrificed to tell a full queue
+//! from an empty one.  Each index is a single byte so reads and writes of it
+//! are atomic on the AVR.
+//! \tparam SIZE The number of bytes held by the queue.  Must be a power
+//! of two between 2 and 128, or zero for no queue at all.
+//! \tparam TAGGED True to keep a tag bit with each byte, see put() and peekTag()
+template <uint8_t SIZE, bool TAGGED = false>
+class RingBuffer : public RingBufferTags<SIZE, TAGGED>
+{
+	static_assert((SIZE & (SIZE - 1)) == 0, "RingBuffer SIZE must be a power of two");
+	static_assert(SIZE <= 128, "RingBuffer SIZE must be 128 or less");
+
+private:
+	static const uint8_t mask = SIZE - 1;
+
+	volatile uint8_t head;				// next slot to write, producer only
+	volatile uint8_t tail;				// next slot to read, consumer only
+	volatile uint8_t data [SIZE];
+
+public:
+	//! \brief Initialises a new empty instance of the RingBuffer class
+	inline RingBuffer () __attribute__((always_inline)) : head(0), tail(0) { }
+
+
+	//! \brief Gets the number of bytes waiting in the queue
+	inline uint8_t count () __attribute__((always_inline))
+	{
+		return head - tail;
+	}
+
+
+	//! \brief Gets the number of bytes that can still be put into the queue
+	inline uint8_t space () __attribute__((always_inline))
+	{
+		return SIZE - count();
+	}
+
+
+	//! \brief Indicates if the queue is empty
+	inline bool isEmpty () __attribute__((always_inline))
+	{
+		return head == tail;
+	}
+
+
+	//! \brief Indicates if the queue is full
+	inline bool isFull () __attribute__((always_inline))
+	{
+		return count() == SIZE;
+	}
+
+
+	//! \brief Adds a byte to the queue
+	//! \details Producer side only.
+	//! \param value The byte to add
+	//! \param tag The tag bit kept with the byte when TAGGED is true
+	//! \return true if the byte was added; false if the queue was full and
+	//! the byte was discarded
+	inline bool put (uint8_t value, bool tag = false) __attribute__((always_inline))
+	{
+		uint8_t h = head;
+		if ((uint8_t)(h - tail) == SIZE)
+			return false;
+
+		data[h & mask] = value;
+		this->setTag (h & mask, tag);
+		head = h + 1;
+		return true;
+	}
+
+
+	//! \brief Removes the oldest byte from the queue
+	//! \details Consumer side only.  The caller must first check that the
+	//! queue is not empty.
+	//! \return The oldest byte in the queue
+	inline uint8_t get () __attribute__((always_inline))
+	{
+		uint8_t t = tail;
+		uint8_t value = data[t & mask];
+		tail = t + 1;
+		return value;
+	}
+
+
+	//! \brief Returns the oldest byte without removing it from the queue
+	//! \details Consumer side only.  The caller must first check that the
+	//! queue is not empty.
+	inline uint8_t peek () __attribute__((always_inline))
+	{
+		return data[tail & mask];
+	}
+
+
+	//! \brief Returns the tag bit of the oldest byte
+	//! \details Consumer side only.  The caller must first check that the
+	//! queue is not empty.  Always false when TAGGED is false.
+	inline bool peekTag () __attribute__((always_inline))
+	{
+		return this->getTag (tail & mask);
+	}
+
+
+	//! \brief Discards everything in the queue
+	//! \details Consumer side only.
+	inline void clear () __attribute__((always_inline))
+	{
+		tail = head;
+	}
+};
+
+
+//! \brief A special case for no queue
+//! \details Holds no data and always appears empty, allowing code that
+//! tests the queue size at compile time to be written without conditionals
+//! in the preprocessor.
+template <bool TAGGED>
+class RingBuffer<0, TAGGED>
+{
+public:
+	inline uint8_t count () __attribute__((always_inline)) { return 0; }
+	inline uint8_t space () __attribute__((always_inline)) { return 0; }
+	inline bool isEmpty () __attribute__((always_inline)) { return true; }
+	inline bool isFull () __attribute__((always_inline)) { return true; }
+	inline bool put (uint8_t, bool = false) __attribute__((always_inline)) { return false; }
+	inline uint8_t get () __attribute__((always_inline)) { return 0; }
+	inline uint8_t peek () __attribute__((always_inline)) { return 0; }
+	inline bool peekTag () __attribute__((always_inline)) { return false; }
+	inline void clear () __attribute__((always_inline)) { }
+};
+
+
+#endif /* RINGBUFFER_H_ */
@@ -100,8 +100,9 @@ public:
 
 	//! \brief Clears the timer overflow interrupt status
 	//! \details Clear the overflow bit in the Interrupt Status Register by setting
-	//! to 1. Use when not the interrupt is not enabled
-	inline void clearOverflow() { _sbi(TTIMER16::tifrRegx, TOV1); }
+	//! to 1. Use when not the interrupt is not enabled.  Only the overflow bit is
+	//! written so no other pending flag is cleared.
+	inline void clearOverflow() { *psfr8_t(TTIMER16::tifrRegx) = _BV(TOV1); }
 
 	
 	//! \brief Gets the state of the overflow status bit
@@ -316,8 +317,14 @@ public:
 
 	//! \brief Clears the Input Capture interrupt status
 	//! \details Clear the input capture bit in the interrupt status register by setting
-	//! to 1. Use when the interrupt is not enabled
-	inline void clearInputCapture() { _sbi(TTIMER16::tifrRegx, ICF1); }
+	//! to 1. Use when the interrupt is not enabled.  Only the capture bit is
+	//! written so no other pending flag is cleared.
+	inline void clearInputCapture() { *psfr8_t(TTIMER16::tifrRegx) = _BV(ICF1); }
+
+
+	//! \brief Gets the state of the input capture status bit
+	//! \details For use when the interrupt is not enabled
+	inline bool isInputCapture () { return bit_is_set (TTIMER16::tifrRegx, ICF1); }
 
 	//! \brief Operator overload that performs the same as the read method
 	inline operator uint16_t() __attribute__((always_inline))
@@ -50,15 +50,63 @@ typedef enum
 } twiDir_t;
 
 
+//! \brief Flags for each segment of a combined transfer
+typedef enum
+{
+	TwiMsgWrite = 0,			//!< Writes the bytes to the device
+	TwiMsgRead = 1,				//!< Reads the bytes from the device
+	TwiMsgNoStart = 2			//!< Carries on writing from the previous write segment
+								//!< without a repeated start or address
+} twiMsgFlags_t;
 
 
-class TwiMasterBase
+//! \brief One segment of a combined transfer
+//! \details Each segment starts with a repeated start and the device address
+//! unless it has TwiMsgNoStart, which joins a write onto the write before it,
+//! such as a register address held apart from the data.
+struct TwiMessage
 {
-// variables
-public:
-protected:
-private:
+	uint8_t device;				//!< The 7 bit device address
+	uint8_t flags;				//!< TwiMsgWrite or TwiMsgRead, with TwiMsgNoStart
+	uint8_t count;				//!< The number of bytes; at least one for a read
+	uint8_t * data;				//!< The bytes to write or where the bytes read go
+};
+
+
+//! \brief Checks that segments can be run as a transfer
+//! \details There must be at least one segment, every read must have at
+//! least one byte for the NAK that ends it, and TwiMsgNoStart may not follow
+//! a read, as the device has not been addressed for a write.
+//! \param messages The segments
+//! \param count The number of segments
+inline bool twiMessagesValid (const TwiMessage * messages, uint8_t count)
+{
+	for (uint8_t i = 0; i < count; i++)
+	{
+		uint8_t flags = messages[i].flags;
 
+		if (flags & TwiMsgRead)
+		{
+			if (messages[i].count == 0)
+				return false;
+		}
+		else if ((flags & TwiMsgNoStart) && i && (messages[i - 1].flags & TwiMsgRead))
+			return false;
+	}
+	return count != 0;
+}
+
+
+
+//! \brief The methods common to every TWI master
+//! \details The bus primitives start, repeatStart, stop, writeDevice,
+//! readDeviceWithAck and readDeviceWithNak are found in TDRIVER at compile
+//! time, so they are called directly and may be inlined into each method.
+//! TwiMaster is built on this unless TWIMASTER_VIRTUAL is defined.
+//! \tparam TDRIVER The class supplying the primitives, derived from this one
+template <class TDRIVER>
+class TwiMasterCore
+{
 // methods:
 public:
 	//! \brief Writes an array of bytes to the I2C device
@@ -70,7 +118,23 @@ public:
 	//! \param sendStop True if the stop condition should be written on the bus, false to allow additional
 	//! writes or reads to follow.
 	//! \returns Number of bytes written
-	bool writeBytes (uint8_t device, uint8_t * data, uint8_t count, bool sendStop=true);
+	bool writeBytes (uint8_t device, uint8_t * data, uint8_t count, bool sendStop=true)
+	{
+		if (driver().start (device, TwiDirWrite))
+		{
+			do
+			{
+				if (!driver().writeDevice (*(data++)))
+					break;
+			} while(--count);
+
+			if (sendStop)
+				driver().stop();
+
+			return true;
+		}
+		return false;
+	}
 
 	//! \brief Reads an array of bytes from the I2C device
 	//! \details This method performs the start or restart condition and then reads the data bytes from the device.
@@ -81,7 +145,20 @@ public:
 	//! \param sendStop True if the stop condition should be written on the bus, false to allow additional
 	//! writes or reads to follow.
 	//! \returns Number of bytes read
-	bool readBytes(uint8_t device, uint8_t * data, uint8_t count, bool sendStop=true);
+	bool readBytes(uint8_t device, uint8_t * data, uint8_t count, bool sendStop=true)
+	{
+		// send the start condition and address byte
+		if (driver().start (device, TwiDirRead))
+		{
+			readAll (data, count);
+
+			if (sendStop)
+				driver().stop();
+
+			return true;
+		}
+		return false;
+	}
 
 	//! \brief Write a single byte to the I2C device
 	//! \details This method simply performs the start condition and then sends two bytes to the device.
@@ -91,7 +168,21 @@ public:
 	//! \param address The address or register in the device
 	//! \param data Data byte should be written
 	//! \returns Number of bytes written
-	bool writeRegister (uint8_t device, uint8_t address, uint8_t data);
+	bool writeRegister (uint8_t device, uint8_t address, uint8_t data)
+	{
+		if (driver().start (device, TwiDirWrite))
+		{
+			if (driver().writeDevice (address))
+			{
+				if (driver().writeDevice (data))
+				{
+					driver().stop();
+					return true;
+				}
+			}
+		}
+		return false;
+	}
 
 	//! \brief Write a series of bytes to the I2C device
 	//! \details This method simply performs the start condition and then a
@@ -103,7 +194,25 @@ public:
 	//! \param data Data bytes to be written
 	//! \param The number of data bytes to send after the address byte
 	//! \returns Number of bytes written
-	bool writeRegister (uint8_t device, uint8_t address, uint8_t * data, uint8_t count);
+	bool writeRegister (uint8_t device, uint8_t address, uint8_t * data, uint8_t count)
+	{
+		bool ret = true;
+
+		if (driver().start (device, TwiDirWrite))
+		{
+			if (driver().writeDevice (address))
+			{
+				for (uint8_t i = 0; i < count; i++)
+				{
+					if (!driver().writeDevice (data[i]))
+						ret = false;
+				}
+				driver().stop();
+				return ret;
+			}
+		}
+		return false;
+	}
 
 	//! \brief Read a single byte from the I2C device
 	//! \details This method simply performs the start condition and then sends the address byte to the device before
@@ -114,7 +223,10 @@ public:
 	//! \param address The address or register in the device
 	//! \param data Pointer to a byte where the read byte will be placed.
 	//! \returns Number of bytes read
-	bool readRegister (uint8_t device, uint8_t address, uint8_t * data);
+	bool readRegister (uint8_t device, uint8_t address, uint8_t * data)
+	{
+		return readRegister (device, address, data, 1);
+	}
 
 	//! \brief Read multiple bytes from the I2C device
 	//! \details This method simply performs the start condition and then sends the address byte to the device before
@@ -125,16 +237,126 @@ public:
 	//! \param address The address or register in the device
 	//! \param data Pointer to the start of an array where the read bytes will be placed.
 	//! \returns Number of bytes read
-	bool readRegister (uint8_t device, uint8_t address, uint8_t * data, uint8_t count);
+	bool readRegister (uint8_t device, uint8_t address, uint8_t * data, uint8_t count)
+	{
+		// send the start condition and address byte
+		if (driver().start (device, TwiDirWrite))
+		{
+			if (driver().writeDevice (address))
+			{
+				if (driver().repeatStart (device, TwiDirRead))
+				{
+					readAll (data, count);
+					driver().stop();
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	//! \brief Runs several segments as one transfer
+	//! \details As Linux i2c_transfer: the segments are run in order with a
+	//! repeated start between them, and the bus is only released with a stop
+	//! at the end, or as soon as a segment fails.
+	//! \code
+	//! uint8_t reg = 0x3b;
+	//! uint8_t sample[6];
+	//! TwiMessage messages[] = {
+	//! 	{ 0x68, TwiMsgWrite, 1, &reg },
+	//! 	{ 0x68, TwiMsgRead, sizeof (sample), sample } };
+	//! twiMaster.transfer (messages, 2);
+	//! \endcode
+	//! \param messages The segments
+	//! \param count The number of segments
+	//! \returns True if every address and byte written was acknowledged;
+	//! false without using the bus if twiMessagesValid() fails
+	bool transfer (TwiMessage * messages, uint8_t count)
+	{
+		if (!twiMessagesValid (messages, count))
+			return false;
+
+		bool ok = true;
+
+		for (uint8_t i = 0; ok && i < count; i++)
+		{
+			TwiMessage & message = messages[i];
+			bool read = message.flags & TwiMsgRead;
+
+			if (i == 0)
+				ok = driver().start (message.device, read ? TwiDirRead : TwiDirWrite);
+			else if (read || !(message.flags & TwiMsgNoStart))
+				ok = driver().repeatStart (message.device, read ? TwiDirRead : TwiDirWrite);
+
+			if (ok && read)
+				readAll (message.data, message.count);
+			for (uint8_t j = 0; ok && !read && j < message.count; j++)
+				ok = driver().writeDevice (message.data[j]);
+		}
+		driver().stop();
+		return ok;
+	}
 
 	//! \brief Scans the I2C bus looking for device
 	//! \details This method addresses each device on the bus in turn and for each that device that
 	//! responds to its address with an ACK the user supplied callback function will be called.
 	//! \param function The user supplied callback which will be called for each slave address that
 	//! responds
-	void scanBus (void (*function)(uint8_t));
+	void scanBus (void (*function)(uint8_t))
+	{
+		for (uint8_t device = 1; device < 0x80; device++)
+		{
+			bool rc = driver().start (device, TwiDirRead);
+			if (rc)
+			{
+				driver().readDeviceWithNak();
+				driver().stop();
+				(*function) (device);
+			}
+		}
+	}
+
+
+private:
+	inline TDRIVER & driver () __attribute__((always_inline))
+	{
+		return *static_cast<TDRIVER *> (this);
+	}
+
+	// reads the bytes, NAKing the last so the device releases the bus
+	void readAll (uint8_t * data, uint8_t count)
+	{
+		if (!count)
+			return;
+
+		do
+		{
+			if (count == 1)
+				*(data++) = driver().readDeviceWithNak();
+			else
+				*(data++) = driver().readDeviceWithAck();
+		} while (--count);
+	}
+};
 
 
+//! \brief A TWI master used through virtual methods
+//! \details For code that has to choose between masters at run time.  Each
+//! bus primitive is then an indirect call and TwiMaster carries a vtable, so
+//! TwiMaster is only derived from this when TWIMASTER_VIRTUAL is defined.
+//! The cost has not been measured.  Estimated from the code, it is the 2
+//! byte vptr and some 16 bytes of vtable in RAM, and 10-20 cycles for each
+//! primitive call; check with avr-size and a cycle count before relying on
+//! these figures.
+class TwiMasterBase : public TwiMasterCore<TwiMasterBase>
+{
+	friend class TwiMasterCore<TwiMasterBase>;
+
+// variables
+public:
+protected:
+private:
+
 protected:
 	//! \brief Performs the start condition on the bus.
 	//! \details Implementers need to develop code to produce a start 
@@ -180,4 +402,15 @@ private:
 };
 
 
+class TwiMaster;
+
+// The class TwiMaster is derived from: TwiMasterCore binds the primitives
+// at compile time; define TWIMASTER_VIRTUAL to use TwiMasterBase instead.
+#if defined (TWIMASTER_VIRTUAL)
+typedef TwiMasterBase TwiMasterParent;
+#else
+typedef TwiMasterCore<TwiMaster> TwiMasterParent;
+#endif
+
+
 #endif /* TWIMASTERBASE_H_ */
\ No newline at end of file
@@ -45,21 +45,61 @@
 #include "twiMasterBase.h"
 
 
-class TwiMaster : public TwiMasterBase
+//! \brief Called from the TWI interrupt when a transfer started by one of
+//! the TwiMaster begin methods has finished
+//! \param ok True if the device acknowledged its address and every byte
+//! written; false on a NAK, bus error or lost arbitration
+typedef void (*twiDone_t) (bool ok);
+
+
+//! \brief Master for the hardware TWI module
+//! \details Transfers can be run from the TWI interrupt: one of the begin
+//! methods starts the transfer and returns straight away, and the interrupt
+//! then moves each byte as the bus is ready for it.  isBusy() or the optional
+//! callback tells when it has finished.  Global interrupts must be enabled
+//! and the interrupt passed on to twiIsr().
+//! \code
+//! ISR(TWI_vect) { twiMaster.twiIsr(); }
+//!
+//! uint8_t sample[6];
+//! twiMaster.beginReadRegister (0x68, 0x3b, sample, sizeof (sample));
+//! ...	// the control loop runs while the bus is busy
+//! if (!twiMaster.isBusy () && twiMaster.isOk ()) ...
+//! \endcode
+//! writeBytes, readBytes, writeRegister, readRegister and transfer run the
+//! same steps with the TWI interrupt left disabled, stepping twiIsr() from
+//! their wait, so these block as before and need no ISR(TWI_vect).  Only the
+//! begin methods need the vector.  The remaining TwiMasterCore methods poll
+//! the bus and must not be used while a transfer is running.
+class TwiMaster : public TwiMasterParent
 {
+	friend class TwiMasterCore<TwiMaster>;
+
 //variables
 public:
 protected:
 private:
 	FastIOOutputPin<SDAPIN> sdaPin;
 	FastIOOutputPin<SCLPIN> sclPin;
+
+	// the transfer run by the interrupt
+	TwiMessage * message;				// the segment on the bus
+	uint8_t remaining;					// segments left, including this one
+	uint8_t index;						// the next byte in the segment
+	TwiMessage segments[2];				// used by the simple begin methods
+	uint8_t command;					// register address written first
+	bool holdBus;						// no stop, a repeated start follows
+	uint8_t interrupt;					// _BV(TWIE), or 0 when polled
+	volatile bool busy;
+	volatile bool success;
+	twiDone_t done;
 	//static const bool released=true;
 	//static const bool low=false;
 
 //functions
 	public:
 	//! \brief Initialises a new instance of the TwiMaster object
-	TwiMaster()
+	TwiMaster() : interrupt(0), busy(false), success(false), done(0)
 	{
 		//	setSpeed(fast);
 		//TWCR=0;
@@ -105,6 +145,259 @@ private:
 		}
 	}
 
+	//! \brief Starts writing bytes to the I2C device from the interrupt
+	//! \details Returns at once; the data must stay in place until the
+	//! transfer has finished.
+	//! \param device The 7 bit device address
+	//! \param data Pointer to the bytes to write
+	//! \param count The number of bytes, zero just to address the device
+	//! \param sendStop False to keep the bus for a repeated start by the next
+	//! transfer
+	//! \param callback Called from the interrupt when the transfer ends
+	//! \returns False if a transfer is already running
+	bool beginWrite (uint8_t device, const uint8_t * data, uint8_t count,
+		bool sendStop = true, twiDone_t callback = 0)
+	{
+		if (busy)
+			return false;
+		setWrite (device, data, count);
+		return begin (segments, 1, sendStop, callback, _BV(TWIE));
+	}
+
+
+	//! \brief Starts reading bytes from the I2C device from the interrupt
+	//! \details Returns at once; the bytes are not valid until the transfer
+	//! has finished.
+	//! \param device The 7 bit device address
+	//! \param data Pointer to where the bytes read should be placed
+	//! \param count The number of bytes to read, at least one
+	//! \param sendStop False to keep the bus for a repeated start by the next
+	//! transfer
+	//! \param callback Called from the interrupt when the transfer ends
+	//! \returns False if a transfer is already running
+	bool beginRead (uint8_t device, uint8_t * data, uint8_t count,
+		bool sendStop = true, twiDone_t callback = 0)
+	{
+		if (busy)
+			return false;
+		setRead (device, data, count);
+		return begin (segments, 1, sendStop, callback, _BV(TWIE));
+	}
+
+
+	//! \brief Starts writing a register address and data from the interrupt
+	//! \param device The 7 bit device address
+	//! \param address The address or register in the device
+	//! \param data Pointer to the bytes to write after the address
+	//! \param count The number of data bytes
+	//! \param callback Called from the interrupt when the transfer ends
+	//! \returns False if a transfer is already running
+	bool beginWriteRegister (uint8_t device, uint8_t address, const uint8_t * data, uint8_t count,
+		twiDone_t callback = 0)
+	{
+		if (busy)
+			return false;
+		setRegister (device, address, TwiMsgWrite | TwiMsgNoStart, const_cast<uint8_t *> (data), count);
+		return begin (segments, 2, true, callback, _BV(TWIE));
+	}
+
+
+	//! \brief Starts reading registers from the interrupt
+	//! \details Writes the register address, then reads the bytes after a
+	//! repeated start.
+	//! \param device The 7 bit device address
+	//! \param address The address or register in the device
+	//! \param data Pointer to where the bytes read should be placed
+	//! \param count The number of bytes to read, at least one
+	//! \param callback Called from the interrupt when the transfer ends
+	//! \returns False if a transfer is already running
+	bool beginReadRegister (uint8_t device, uint8_t address, uint8_t * data, uint8_t count,
+		twiDone_t callback = 0)
+	{
+		if (busy)
+			return false;
+		setRegister (device, address, TwiMsgRead, data, count);
+		return begin (segments, 2, true, callback, _BV(TWIE));
+	}
+
+
+	//! \brief Starts running several segments as one transfer from the interrupt
+	//! \details As TwiMasterCore::transfer.  Returns at once; the segments
+	//! and their data must stay in place until the transfer has finished.
+	//! \param messages The segments
+	//! \param count The number of segments, at least one
+	//! \param callback Called from the interrupt when the transfer ends
+	//! \returns False if a transfer is already running or twiMessagesValid()
+	//! fails
+	bool beginTransfer (TwiMessage * messages, uint8_t count, twiDone_t callback = 0)
+	{
+		return begin (messages, count, true, callback, _BV(TWIE));
+	}
+
+
+	//! \brief Checks if a transfer is running
+	inline bool isBusy () __attribute__((always_inline))
+	{
+		return busy;
+	}
+
+
+	//! \brief Checks if the last transfer was acknowledged throughout
+	inline bool isOk () __attribute__((always_inline))
+	{
+		return success;
+	}
+
+
+	//! \brief Waits for the running transfer to finish
+	//! \details If the transfer was started without the interrupt, or global
+	//! interrupts are disabled, the transfer is moved on from here instead.
+	//! \returns True if the transfer was acknowledged throughout
+	bool wait ()
+	{
+		while (busy)
+		{
+			if ((!interrupt || bit_is_clear (SREG, SREG_I)) && bit_is_set (TWCR, TWINT))
+				twiIsr ();
+		}
+		return success;
+	}
+
+
+	//! \brief Writes an array of bytes to the I2C device and waits
+	//! \details As TwiMasterCore::writeBytes, polled without the interrupt.
+	//! \returns True if every byte was acknowledged
+	bool writeBytes (uint8_t device, uint8_t * data, uint8_t count, bool sendStop = true)
+	{
+		if (busy)
+			return false;
+		setWrite (device, data, count);
+		return begin (segments, 1, sendStop, 0, 0) && wait ();
+	}
+
+
+	//! \brief Reads an array of bytes from the I2C device and waits
+	//! \details As TwiMasterCore::readBytes, polled without the interrupt.
+	//! \returns True if the device acknowledged its address
+	bool readBytes (uint8_t device, uint8_t * data, uint8_t count, bool sendStop = true)
+	{
+		if (busy)
+			return false;
+		setRead (device, data, count);
+		return begin (segments, 1, sendStop, 0, 0) && wait ();
+	}
+
+
+	//! \brief Writes a single register and waits
+	//! \details As TwiMasterCore::writeRegister, polled without the interrupt.
+	bool writeRegister (uint8_t device, uint8_t address, uint8_t data)
+	{
+		return writeRegister (device, address, &data, 1);
+	}
+
+
+	//! \brief Writes a series of registers and waits
+	//! \details As TwiMasterCore::writeRegister, polled without the interrupt.
+	bool writeRegister (uint8_t device, uint8_t address, uint8_t * data, uint8_t count)
+	{
+		if (busy)
+			return false;
+		setRegister (device, address, TwiMsgWrite | TwiMsgNoStart, data, count);
+		return begin (segments, 2, true, 0, 0) && wait ();
+	}
+
+
+	//! \brief Reads a single register and waits
+	//! \details As TwiMasterCore::readRegister, polled without the interrupt.
+	bool readRegister (uint8_t device, uint8_t address, uint8_t * data)
+	{
+		return readRegister (device, address, data, 1);
+	}
+
+
+	//! \brief Reads a series of registers and waits
+	//! \details As TwiMasterCore::readRegister, polled without the interrupt.
+	bool readRegister (uint8_t device, uint8_t address, uint8_t * data, uint8_t count)
+	{
+		if (busy)
+			return false;
+		setRegister (device, address, TwiMsgRead, data, count);
+		return begin (segments, 2, true, 0, 0) && wait ();
+	}
+
+
+	//! \brief Runs several segments as one transfer and waits
+	//! \details As TwiMasterCore::transfer, polled without the interrupt.
+	bool transfer (TwiMessage * messages, uint8_t count)
+	{
+		return begin (messages, count, true, 0, 0) && wait ();
+	}
+
+
+	//! \brief Moves the running transfer on by one step
+	//! \details Called from the TWI interrupt each time the bus is ready,
+	//! or from wait() for a polled transfer.
+	void twiIsr ()
+	{
+		const uint8_t next = _BV(TWINT) | _BV(TWEN) | interrupt;
+
+		switch (TW_STATUS)
+		{
+		case TW_START:
+		case TW_REP_START:
+			TWDR = (message->device << 1) | (message->flags & TwiMsgRead);
+			TWCR = next;
+			break;
+
+		case TW_MT_SLA_ACK:
+		case TW_MT_DATA_ACK:
+			// run on into any segments that carry on the write
+			while (index == message->count)
+			{
+				if (!nextSegment ())
+					return;
+				if ((message->flags & (TwiMsgRead | TwiMsgNoStart)) != TwiMsgNoStart)
+				{
+					TWCR = next | _BV(TWSTA);
+					return;
+				}
+			}
+			TWDR = message->data[index++];
+			TWCR = next;
+			break;
+
+		case TW_MR_DATA_ACK:
+			message->data[index++] = TWDR;
+			// fall through
+		case TW_MR_SLA_ACK:
+			// NAK the last byte so the device lets go of the bus
+			if (message->count - index > 1)
+				TWCR = next | _BV(TWEA);
+			else
+				TWCR = next;
+			break;
+
+		case TW_MR_DATA_NACK:
+			message->data[index] = TWDR;
+			index = message->count;
+			if (nextSegment ())
+				TWCR = next | _BV(TWSTA);
+			break;
+
+		case TW_MT_ARB_LOST:
+			// the other master has the bus, so no stop is sent
+			TWCR = _BV(TWINT) | _BV(TWEN);
+			complete (false);
+			break;
+
+		default:
+			// a NAK or a bus error
+			holdBus = false;
+			finish (false);
+			break;
+		}
+	}
+
 protected:
 	//! \brief Issues start condition and sends SLA and transfer direction
 	//! \details Issues the start condition on the I2C bus and sends the SLA
@@ -244,6 +537,98 @@ protected:
 	}
 
 private:
+	inline void setSegment (uint8_t i, uint8_t device, uint8_t flags, uint8_t * data, uint8_t count) __attribute__((always_inline))
+	{
+		segments[i].device = device;
+		segments[i].flags = flags;
+		segments[i].count = count;
+		segments[i].data = data;
+	}
+
+
+	inline void setWrite (uint8_t device, const uint8_t * data, uint8_t count) __attribute__((always_inline))
+	{
+		setSegment (0, device, TwiMsgWrite, const_cast<uint8_t *> (data), count);
+	}
+
+
+	inline void setRead (uint8_t device, uint8_t * data, uint8_t count) __attribute__((always_inline))
+	{
+		setSegment (0, device, TwiMsgRead, data, count);
+	}
+
+
+	// the register address, then the data written on or read after a
+	// repeated start
+	inline void setRegister (uint8_t device, uint8_t address, uint8_t flags, uint8_t * data, uint8_t count) __attribute__((always_inline))
+	{
+		command = address;
+		setSegment (0, device, TwiMsgWrite, &command, 1);
+		setSegment (1, device, flags, data, count);
+	}
+
+
+	// sets up the transfer and sends the start, or a repeated start if the
+	// last transfer kept the bus; enable is _BV(TWIE) to run the transfer
+	// from the interrupt, or 0 for wait() to poll it
+	bool begin (TwiMessage * messages, uint8_t count, bool sendStop, twiDone_t callback,
+		uint8_t enable)
+	{
+		if (busy || !twiMessagesValid (messages, count))
+			return false;
+
+		message = messages;
+		remaining = count;
+		index = 0;
+		holdBus = !sendStop;
+		done = callback;
+		interrupt = enable;
+		busy = true;
+
+		// a stop still going out must finish before the next start
+		while (TWCR & _BV(TWSTO))
+			continue;
+
+		TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | enable;
+		return true;
+	}
+
+
+	// moves on to the next segment, or finishes the transfer after the last
+	bool nextSegment ()
+	{
+		if (--remaining == 0)
+		{
+			finish (true);
+			return false;
+		}
+		message++;
+		index = 0;
+		return true;
+	}
+
+
+	// ends the transfer with a stop, or holds the bus with SCL low by
+	// leaving TWINT set until the next start
+	void finish (bool ok)
+	{
+		if (holdBus)
+			TWCR = _BV(TWEN);
+		else
+			TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);
+		complete (ok);
+	}
+
+
+	void complete (bool ok)
+	{
+		success = ok;
+		busy = false;
+		if (done)
+			(*done) (ok);
+	}
+
+
 	TwiMaster( const TwiMaster &c );
 	TwiMaster& operator=( const TwiMaster &c );
 
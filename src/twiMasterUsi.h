@@ -51,8 +51,10 @@
 #define TWI_NACK_BIT  0       // Bit position for (N)ACK bit.
 
 
-class TwiMaster : public TwiMasterBase
+class TwiMaster : public TwiMasterParent
 {
+	friend class TwiMasterCore<TwiMaster>;
+
 //variables
 public:
 protected:
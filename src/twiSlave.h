@@ -0,0 +1,55 @@
+//***************************************************************************
+//
+//  File Name :		twiSlave.h
+//
+//  Project :		Library for the Atmel 8 bit AVR MCU
+//
+//  Purpose :		TWI (I2C) slave for the Atmel 8 bit AVR MCU
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013-2016 Andy Burgess
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//  Revisions :
+//
+//      see rcs below
+//
+//***************************************************************************
+
+
+
+#ifndef TWISLAVE_H_
+#define TWISLAVE_H_
+
+
+#include "twiPins.h"
+
+
+#if defined (_HAS_USI_TWI)
+#include "twiSlaveUsi.h"
+#endif
+
+#if defined (_HAS_TWI)
+#include "twiSlaveTwi.h"
+#endif
+
+
+#endif /* TWISLAVE_H_ */
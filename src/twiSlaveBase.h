@@ -0,0 +1,168 @@
+//***************************************************************************
+//
+//  File Name :		twiSlaveBase.h
+//
+//  Project :		Library for the Atmel 8 bit AVR MCU
+//
+//  Purpose :		Register file shared by the TWI and USI slaves
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013-2016 Andy Burgess
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//  Revisions :
+//
+//      see rcs below
+//
+//***************************************************************************
+
+
+
+#ifndef TWISLAVEBASE_H_
+#define TWISLAVEBASE_H_
+
+#include <stdint.h>
+
+
+//! \brief Called after the master has written to the registers
+//! \param first The index of the first register written
+//! \param count The number of registers written
+typedef void (*twiSlaveWrite_t) (uint8_t first, uint8_t count);
+
+
+//! \brief An array of registers read and written by the master
+//! \details The model most I2C peripherals use: the first byte of a write
+//! sets the register pointer, and each byte written or read after it moves
+//! the pointer on by one, wrapping to zero past the last register.  So a
+//! master writes registers with
+//! \code
+//! S addr+W reg data data ... P
+//! \endcode
+//! and reads them with
+//! \code
+//! S addr+W reg Sr addr+R data data ... P
+//! \endcode
+//! or carries on from where the last transfer left off with just the read.
+//! Every method is called from the slave's interrupt.
+class TwiSlaveRegisters
+{
+private:
+	volatile uint8_t * registers;
+	uint8_t size;
+	uint8_t pointer;					// the register read or written next
+	uint8_t first;						// where this write began
+	uint8_t written;					// bytes written by this write
+	bool setPointer;					// the next byte received is the pointer
+	twiSlaveWrite_t callback;
+
+public:
+	//! \brief Initialises a new instance of the TwiSlaveRegisters class
+	inline TwiSlaveRegisters () __attribute__((always_inline))
+		: registers(0), size(0), pointer(0), first(0), written(0), setPointer(false), callback(0) { }
+
+
+	//! \brief Sets the registers
+	//! \param data The registers, which must not be empty
+	//! \param count The number of registers
+	inline void set (volatile uint8_t * data, uint8_t count) __attribute__((always_inline))
+	{
+		registers = data;
+		size = count;
+		pointer = 0;
+	}
+
+
+	//! \brief Sets a function to be called after registers are written
+	inline void setWriteCallback (twiSlaveWrite_t function) __attribute__((always_inline))
+	{
+		callback = function;
+	}
+
+
+	//! \brief The master has addressed the slave to write to it
+	inline void startWrite () __attribute__((always_inline))
+	{
+		setPointer = true;
+		written = 0;
+	}
+
+
+	//! \brief Stores a byte written by the master
+	inline void receive (uint8_t data) __attribute__((always_inline))
+	{
+		if (setPointer)
+		{
+			setPointer = false;
+			pointer = (data < size) ? data : 0;
+			first = pointer;
+		}
+		else
+		{
+			registers[pointer] = data;
+			advance ();
+			if (written < size)
+				written++;
+		}
+	}
+
+
+	//! \brief Gets the next byte to send to the master
+	inline uint8_t transmit () __attribute__((always_inline))
+	{
+		uint8_t data = registers[pointer];
+		advance ();
+		return data;
+	}
+
+
+	//! \brief Gets the next byte to send without moving the pointer on
+	//! \details For a slave that fetches each byte ahead of time, and calls
+	//! advance() once the byte is on its way to the master.
+	inline uint8_t peek () __attribute__((always_inline))
+	{
+		return registers[pointer];
+	}
+
+
+	//! \brief Moves the pointer on to the next register
+	inline void advance () __attribute__((always_inline))
+	{
+		if (++pointer >= size)
+			pointer = 0;
+	}
+
+
+	//! \brief The write has ended with a stop or repeated start
+	//! \details Calls the write callback if any registers were written.
+	inline void stop () __attribute__((always_inline))
+	{
+		if (written)
+		{
+			uint8_t count = written;
+			written = 0;
+			if (callback)
+				(*callback) (first, count);
+		}
+	}
+};
+
+
+#endif /* TWISLAVEBASE_H_ */
@@ -0,0 +1,166 @@
+//***************************************************************************
+//
+//  File Name :		twiSlaveTwi.h
+//
+//  Project :		Library for the Atmel 8 bit AVR MCU
+//
+//  Purpose :		Interrupt driven TWI slave using the hardware TWI module
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013-2016 Andy Burgess
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//  Revisions :
+//
+//      see rcs below
+//
+//***************************************************************************
+
+
+
+#ifndef TWISLAVETWI_H_
+#define TWISLAVETWI_H_
+
+
+#include <util/twi.h>
+#include "twiSlaveBase.h"
+
+
+//! \brief A register file slave on the hardware TWI module
+//! \details Runs entirely from the TWI interrupt: the module matches the
+//! address and the interrupt stores or fetches each byte with
+//! TwiSlaveRegisters, so the main code only sees the registers change.
+//! \code
+//! volatile uint8_t registers [16];
+//! TwiSlave slave;
+//! ISR(TWI_vect) { slave.twiIsr(); }
+//!
+//! slave.setWriteCallback (changed);
+//! slave.init (0x42, registers, sizeof (registers));
+//! sei ();
+//! \endcode
+//! The module holds SCL low from the end of each byte until the interrupt
+//! has dealt with it, estimated at about 3us at 16MHz but not measured,
+//! well inside the 22.5us a byte takes at 400kHz.  Other interrupts that run for long delay it, so keep
+//! them short or let them be interrupted.  The write callback is called
+//! after SCL has been released.  The registers are not written atomically,
+//! so registers wider than a byte should be read and updated with
+//! interrupts disabled.
+class TwiSlave
+{
+//variables
+public:
+protected:
+private:
+	TwiSlaveRegisters file;
+
+	// acknowledges the next byte and clears the interrupt
+	static const uint8_t ack = _BV(TWINT) | _BV(TWEA) | _BV(TWEN) | _BV(TWIE);
+
+//functions
+public:
+	//! \brief Initialises a new instance of the TwiSlave object
+	TwiSlave() { }
+
+
+	//! \brief Starts answering to the address
+	//! \param address The 7 bit slave address
+	//! \param registers The registers, at least one
+	//! \param count The number of registers
+	//! \param generalCall True to also accept writes to the general call address
+	void init (uint8_t address, volatile uint8_t * registers, uint8_t count, bool generalCall = false)
+	{
+		file.set (registers, count);
+		TWAR = (address << 1) | (generalCall ? _BV(TWGCE) : 0);
+		TWCR = ack;
+	}
+
+
+	//! \brief Stops answering and disables the TWI module
+	inline void disable () __attribute__((always_inline))
+	{
+		TWCR = 0;
+	}
+
+
+	//! \brief Sets a function to be called after the master writes registers
+	//! \details It is called from the interrupt at the stop or repeated
+	//! start, so it should be short.
+	//! \param callback The function, or 0 for none
+	inline void setWriteCallback (twiSlaveWrite_t callback) __attribute__((always_inline))
+	{
+		file.setWriteCallback (callback);
+	}
+
+
+	//! \brief Handles the TWI interrupt
+	//! \details Called from ISR(TWI_vect).
+	void twiIsr ()
+	{
+		switch (TW_STATUS)
+		{
+		case TW_SR_SLA_ACK:
+		case TW_SR_ARB_LOST_SLA_ACK:
+		case TW_SR_GCALL_ACK:
+		case TW_SR_ARB_LOST_GCALL_ACK:
+			file.startWrite ();
+			TWCR = ack;
+			break;
+
+		case TW_SR_DATA_ACK:
+		case TW_SR_GCALL_DATA_ACK:
+			file.receive (TWDR);
+			TWCR = ack;
+			break;
+
+		case TW_SR_STOP:
+			TWCR = ack;
+			file.stop ();
+			break;
+
+		case TW_ST_SLA_ACK:
+		case TW_ST_ARB_LOST_SLA_ACK:
+		case TW_ST_DATA_ACK:
+			TWDR = file.transmit ();
+			TWCR = ack;
+			break;
+
+		case TW_BUS_ERROR:
+			// releases the lines without sending a stop
+			TWCR = ack | _BV(TWSTO);
+			break;
+
+		default:
+			// the master has NAK'd the last byte read, or a byte arrived
+			// after a NAK; wait to be addressed again
+			TWCR = ack;
+			break;
+		}
+	}
+
+private:
+	TwiSlave( const TwiSlave &c );
+	TwiSlave& operator=( const TwiSlave &c );
+
+}; //TwiSlave
+
+
+#endif /* TWISLAVETWI_H_ */
@@ -0,0 +1,297 @@
+//***************************************************************************
+//
+//  File Name :		twiSlaveUsi.h
+//
+//  Project :		Library for the Atmel 8 bit AVR MCU
+//
+//  Purpose :		Interrupt driven TWI slave using the USI module
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013-2016 Andy Burgess
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//  Revisions :
+//
+//      see rcs below
+//
+//***************************************************************************
+
+
+
+#ifndef TWISLAVEUSI_H_
+#define TWISLAVEUSI_H_
+
+
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "CommonDefs.h"
+#include "FastIO.h"
+#include "twiSlaveBase.h"
+
+
+//! \brief A register file slave on the USI module
+//! \details The same register model as the TWI slave, run from the USI
+//! start condition and counter overflow interrupts.  The start condition
+//! interrupt arms the counter for the address byte; after that each
+//! overflow moves the transfer on by a byte or by an ACK bit.
+//! \code
+//! volatile uint8_t registers [8];
+//! TwiSlave slave;
+//! ISR(USI_START_vect) { slave.startIsr(); }
+//! ISR(USI_OVF_vect) { slave.overflowIsr(); }
+//!
+//! slave.init (0x42, registers, sizeof (registers));
+//! sei ();
+//! for (;;)
+//! {
+//! 	slave.checkStop ();
+//! 	...
+//! }
+//! \endcode
+//! Some parts name the vectors USI_STR_vect and USI_OVERFLOW_vect.
+//!
+//! The USI holds SCL low after each overflow until the interrupt clears it,
+//! so the interrupt does only what is needed before letting go: the next
+//! byte to send is fetched from the registers while the previous ACK bit is
+//! on the bus and is written straight to USIDR.  SCL should then be held
+//! for the interrupt latency plus about 10 cycles, an estimate of some
+//! 3-4us at 8MHz counted from the source, not measured.
+//!
+//! \warning Bus timing is unverified.  test/twislaveusi.cpp only checks the
+//! protocol, stepping the handlers against a simulated master; it has not
+//! been run against a real 100kHz or 400kHz master, nor has the SCL hold
+//! time been measured on a part.
+//!
+//! The USI flags a stop condition but has no interrupt for it, so a write
+//! ending in a stop is only seen by checkStop() or at the next start; the
+//! write callback is made from whichever comes first.
+class TwiSlave
+{
+//variables
+public:
+protected:
+private:
+	FastIOPin<SDAPIN> sdaPin;
+	FastIOPin<SCLPIN> sclPin;
+	TwiSlaveRegisters file;
+	uint8_t slaveAddress;
+	bool generalCall;
+	volatile uint8_t state;
+	uint8_t next;						// the byte to send, fetched ahead
+
+	static const uint8_t stateAddress = 0;		// receiving the address
+	static const uint8_t stateSend = 1;			// ACK sent or received, send a byte
+	static const uint8_t stateReadAck = 2;		// byte sent, read the master's ACK
+	static const uint8_t stateCheckAck = 3;		// the master's ACK has been read
+	static const uint8_t stateReceive = 4;		// ACK sent, receive a byte
+	static const uint8_t stateStore = 5;		// byte received, store it and ACK
+
+	// two wire mode clocked by the external SCL, either waiting for a start
+	// or holding SCL low after each counter overflow
+	static const uint8_t waitStart = _BV(USISIE) | _BV(USIWM1) | _BV(USICS1);
+	static const uint8_t running = _BV(USISIE) | _BV(USIOIE) | _BV(USIWM1) | _BV(USIWM0) | _BV(USICS1);
+
+	// clears the flags, releasing SCL, and counts 8 bits or 1 bit
+	static const uint8_t count8 = _BV(USIOIF) | _BV(USIPF) | _BV(USIDC);
+	static const uint8_t count1 = count8 | (0x0e << USICNT0);
+
+//functions
+public:
+	//! \brief Initialises a new instance of the TwiSlave object
+	TwiSlave() : slaveAddress(0), generalCall(false), state(stateAddress), next(0) { }
+
+
+	//! \brief Starts answering to the address
+	//! \param address The 7 bit slave address
+	//! \param registers The registers, at least one
+	//! \param count The number of registers
+	//! \param generalCall True to also accept writes to the general call address
+	void init (uint8_t address, volatile uint8_t * registers, uint8_t count, bool generalCall = false)
+	{
+		file.set (registers, count);
+		slaveAddress = address;
+		this->generalCall = generalCall;
+
+		// Force primary interface (PORTB)
+		#if defined (USIPOS)
+		_cbi(USIPP, USIPOS);
+		#endif
+
+		// both lines released; SDA is only driven to send
+		sclPin.set();
+		sdaPin.set();
+		sclPin.setOutputMode();
+		sdaPin.setInputMode();
+
+		waitForStart();
+	}
+
+
+	//! \brief Stops answering and releases the lines
+	inline void disable () __attribute__((always_inline))
+	{
+		USICR = 0;
+		sclPin.setInputMode();
+		sdaPin.setInputMode();
+	}
+
+
+	//! \brief Sets a function to be called after the master writes registers
+	//! \details It is called from checkStop() or the start condition
+	//! interrupt, so it should be short.
+	//! \param callback The function, or 0 for none
+	inline void setWriteCallback (twiSlaveWrite_t callback) __attribute__((always_inline))
+	{
+		file.setWriteCallback (callback);
+	}
+
+
+	//! \brief Ends a write that the master has finished with a stop
+	//! \details Call from the main loop or a timer interrupt so the write
+	//! callback is made soon after the stop.
+	void checkStop ()
+	{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			if (bit_is_set (USISR, USIPF))
+			{
+				waitForStart();
+				file.stop ();
+			}
+		}
+	}
+
+
+	//! \brief Handles the USI start condition interrupt
+	void startIsr ()
+	{
+		// a repeated start ends a write just as a stop does
+		file.stop ();
+		state = stateAddress;
+		sdaPin.setInputMode();
+
+		// the start is complete once SCL is low, unless a stop follows
+		bool stop = false;
+		while (sclPin.read() && !(stop = sdaPin.read()))
+			continue;
+
+		USICR = stop ? waitStart : running;
+		USISR = _BV(USISIF) | count8;
+	}
+
+
+	//! \brief Handles the USI counter overflow interrupt
+	void overflowIsr ()
+	{
+		switch (state)
+		{
+		case stateAddress:
+		{
+			uint8_t data = USIDR;
+			uint8_t device = data >> 1;
+
+			if (device == slaveAddress || (generalCall && data == 0))
+			{
+				sendAck();
+				if (data & 1)
+				{
+					state = stateSend;
+					next = file.peek ();
+				}
+				else
+				{
+					state = stateReceive;
+					file.startWrite ();
+				}
+			}
+			else
+				waitForStart();
+			break;
+		}
+
+		case stateCheckAck:
+			// a NAK means the master has read all it wants
+			if (USIDR & 1)
+			{
+				waitForStart();
+				break;
+			}
+			// fall through
+		case stateSend:
+			USIDR = next;
+			sdaPin.setOutputMode();
+			USISR = count8;
+			state = stateReadAck;
+			file.advance ();
+			next = file.peek ();
+			break;
+
+		case stateReadAck:
+			sdaPin.setInputMode();
+			USIDR = 0;
+			USISR = count1;
+			state = stateCheckAck;
+			break;
+
+		case stateReceive:
+			sdaPin.setInputMode();
+			USISR = count8;
+			state = stateStore;
+			break;
+
+		case stateStore:
+		{
+			uint8_t data = USIDR;
+			sendAck();
+			state = stateReceive;
+			file.receive (data);
+			break;
+		}
+		}
+	}
+
+private:
+	// drives SDA low for one bit
+	inline void sendAck () __attribute__((always_inline))
+	{
+		USIDR = 0;
+		sdaPin.setOutputMode();
+		USISR = count1;
+	}
+
+
+	// lets go of the bus until the next start condition
+	inline void waitForStart () __attribute__((always_inline))
+	{
+		sdaPin.setInputMode();
+		USICR = waitStart;
+		USISR = count8;
+	}
+
+
+	TwiSlave( const TwiSlave &c );
+	TwiSlave& operator=( const TwiSlave &c );
+
+}; //TwiSlave
+
+
+#endif /* TWISLAVEUSI_H_ */
@@ -43,10 +43,54 @@
 #include <stdio.h>
 #include <avr/io.h>
 #include <commondefs.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <avr/pgmspace.h>
+#include <ringbuffer.h>
+#include <crc.h>
+#include <uartformat.h>
+
+
+// The largest error, in tenths of a percent, accepted between the requested
+// and actual baudrate.  The default allows 115200 from a 16MHz clock (2.1%).
+#ifndef UART_BAUD_TOL
+#define UART_BAUD_TOL 25
+#endif
+
+
+// Size of the interrupt driven receive and transmit queues for each of the
+// predefined uart objects.  Zero leaves that direction in polled mode.
+#ifndef UART0_RXSIZE
+#define UART0_RXSIZE 0
+#endif
+
+#ifndef UART0_TXSIZE
+#define UART0_TXSIZE 0
+#endif
+
+#ifndef UART1_RXSIZE
+#define UART1_RXSIZE 0
+#endif
+
+#ifndef UART1_TXSIZE
+#define UART1_TXSIZE 0
+#endif
 
+#ifndef UART2_RXSIZE
+#define UART2_RXSIZE 0
+#endif
 
-#ifndef MAX_UARTBUF
-#define MAX_UARTBUF 80
+#ifndef UART2_TXSIZE
+#define UART2_TXSIZE 0
+#endif
+
+#ifndef UART3_RXSIZE
+#define UART3_RXSIZE 0
+#endif
+
+#ifndef UART3_TXSIZE
+#define UART3_TXSIZE 0
 #endif
 
 
@@ -77,122 +121,1293 @@ enum uart_parity_t
 };
 
 
+//! \brief An enumeration of the actions taken when the transmit queue is full
+enum uart_txfull_t
+{
+	txFullBlock,		//!< wait for the interrupt to make room
+	txFullDrop,			//!< discard the new byte
+	txFullOverwrite		//!< discard the oldest queued byte to make room
+};
+
+
+//! \brief Calculates the baudrate register settings at compile time
+//! \details Works out the nearest UBRR value with and without the clock
+//! doubler and selects the one with the lower error, preferring normal
+//! speed on a tie as it samples each bit more times.
+//! \tparam FCPU The CPU clock frequency
+//! \tparam RATE The required baudrate
+template <uint32_t FCPU, uint32_t RATE>
+struct UartBaud
+{
+	static_assert(RATE != 0, "Baudrate cannot be zero");
+
+	//! \brief Nearest UBRR value in normal and double speed modes
+	static const uint32_t ubrr1x = (FCPU + 8UL * RATE) / (16UL * RATE) - 1;
+	static const uint32_t ubrr2x = (FCPU + 4UL * RATE) / (8UL * RATE) - 1;
+
+	//! \brief True if the UBRR value fits the 12 bit register
+	static const bool fits1x = (FCPU >= 8UL * RATE) && ubrr1x <= 4095;
+	static const bool fits2x = (FCPU >= 4UL * RATE) && ubrr2x <= 4095;
+
+	//! \brief Difference between the CPU clock and the clock the baudrate needs
+	static const uint64_t err1x = FCPU > 16ULL * (ubrr1x + 1) * RATE ?
+		FCPU - 16ULL * (ubrr1x + 1) * RATE : 16ULL * (ubrr1x + 1) * RATE - FCPU;
+	static const uint64_t err2x = FCPU > 8ULL * (ubrr2x + 1) * RATE ?
+		FCPU - 8ULL * (ubrr2x + 1) * RATE : 8ULL * (ubrr2x + 1) * RATE - FCPU;
+
+	//! \brief True if the clock doubler should be used
+	static const bool use2x = fits2x && (!fits1x || err2x < err1x);
+
+	//! \brief The value for the UBRR register
+	static const uint16_t ubrr = use2x ? ubrr2x : ubrr1x;
+
+	//! \brief True if the rate can be set at all
+	static const bool reachable = fits1x || fits2x;
+
+	//! \brief True if the rate can be set within UART_BAUD_TOL
+	static const bool valid = reachable &&
+		(use2x ? err2x : err1x) * 1000 <= (uint64_t)UART_BAUD_TOL * FCPU;
+};
+
+
+//! \brief Bit set in a packed baudrate setting when the clock doubler is used
+#define UART_BAUD_2X		0x8000
+
+//! \brief Packed baudrate setting for a rate that cannot be used
+#define UART_BAUD_INVALID	0xffff
+
+
+//! \brief An entry of the run time baudrate table
+struct uart_baud_t
+{
+	uint32_t rate;			//!< the baudrate
+	uint16_t setting;		//!< UBRR value, or'd with UART_BAUD_2X if needed
+};
+
+
+//! \brief Table of the standard baudrates used by Uart::setBaud(uint32_t)
+//! \details The table is calculated by the compiler and held in flash.
+//! \tparam FCPU The CPU clock frequency
+template <uint32_t FCPU>
+struct UartBaudTable
+{
+	template <uint32_t RATE>
+	struct entry
+	{
+		static const uint16_t setting = !UartBaud<FCPU, RATE>::valid ? UART_BAUD_INVALID :
+			UartBaud<FCPU, RATE>::ubrr | (UartBaud<FCPU, RATE>::use2x ? UART_BAUD_2X : 0);
+	};
+
+	static const uint8_t count = 17;
+	static const uart_baud_t entries [count];
+};
+
+template <uint32_t FCPU>
+const uart_baud_t UartBaudTable<FCPU>::entries [UartBaudTable<FCPU>::count] PROGMEM =
+{
+	{ 300, entry<300>::setting },
+	{ 600, entry<600>::setting },
+	{ 1200, entry<1200>::setting },
+	{ 2400, entry<2400>::setting },
+	{ 4800, entry<4800>::setting },
+	{ 9600, entry<9600>::setting },
+	{ 14400, entry<14400>::setting },
+	{ 19200, entry<19200>::setting },
+	{ 28800, entry<28800>::setting },
+	{ 38400, entry<38400>::setting },
+	{ 57600, entry<57600>::setting },
+	{ 76800, entry<76800>::setting },
+	{ 115200, entry<115200>::setting },
+	{ 230400, entry<230400>::setting },
+	{ 250000, entry<250000>::setting },
+	{ 500000, entry<500000>::setting },
+	{ 1000000, entry<1000000>::setting },
+};
+
+
+//! \brief Stands in for a FastIO pin in UartOptions when no pin is used
+//! \details Every method does nothing, so the code that would drive the pin
+//! is removed by the compiler.
+struct UartNoPin
+{
+	inline UartNoPin (bool = false) __attribute__((always_inline)) { }
+	inline void set () __attribute__((always_inline)) { }
+	inline void clear () __attribute__((always_inline)) { }
+	inline void write (bool) __attribute__((always_inline)) { }
+	inline bool read () __attribute__((always_inline)) { return false; }
+};
+
+
+//! \brief Indicates at compile time if a UartOptions pin type is a real pin
+template <class TPIN>
+struct UartHasPin { static const bool value = true; };
+
+template <>
+struct UartHasPin<UartNoPin> { static const bool value = false; };
+
+
+//! \brief The counters kept by UartStats
+struct uart_stats_t
+{
+	uint32_t bytesIn;			//!< data bytes received
+	uint32_t bytesOut;			//!< bytes written to the transmitter
+	uint16_t frameErrors;		//!< bytes received with a framing error
+	uint16_t overruns;			//!< bytes received after data was lost to an overrun
+	uint16_t parityErrors;		//!< bytes received with a parity error
+	uint16_t rxDropped;			//!< bytes discarded because the receive queue was full
+	uint16_t txStalls;			//!< writes that found the transmit queue full
+	uint8_t rxHighWater;		//!< most bytes ever waiting in the receive queue
+	uint8_t txHighWater;		//!< most bytes ever waiting in the transmit queue
+};
+
+
+//! \brief Keeps the uart_stats_t counters, see UartOptions::stats
+//! \details Each update is made by the interrupt routine or, for the
+//! transmit side, by write() while the transmit interrupt is idle, so none
+//! needs a lock.  The counters wrap rather than saturate.
+class UartStats
+{
+private:
+	uart_stats_t counts;
+
+public:
+	static const bool enabled = true;
+
+	inline UartStats () __attribute__((always_inline)) { clear(); }
+
+	inline void received (uint8_t status) __attribute__((always_inline))
+	{
+		counts.bytesIn++;
+		if (status & _BV(FE0))
+			counts.frameErrors++;
+		if (status & _BV(DOR0))
+			counts.overruns++;
+		if (status & _BV(UPE0))
+			counts.parityErrors++;
+	}
+
+	inline void rxDropped () __attribute__((always_inline)) { counts.rxDropped++; }
+	inline void sent () __attribute__((always_inline)) { counts.bytesOut++; }
+	inline void txStall () __attribute__((always_inline)) { counts.txStalls++; }
+
+	inline void rxLevel (uint8_t count) __attribute__((always_inline))
+	{
+		if (count > counts.rxHighWater)
+			counts.rxHighWater = count;
+	}
+
+	inline void txLevel (uint8_t count) __attribute__((always_inline))
+	{
+		if (count > counts.txHighWater)
+			counts.txHighWater = count;
+	}
+
+	inline void copy (uart_stats_t & to) __attribute__((always_inline)) { to = counts; }
+
+	inline void clear () __attribute__((always_inline))
+	{
+		uint8_t * p = reinterpret_cast<uint8_t *> (&counts);
+		for (uint8_t i = 0; i < sizeof(counts); i++)
+			p[i] = 0;
+	}
+};
+
+
+//! \brief Stands in for UartStats when no counters are kept
+//! \details Every method does nothing so the counting is removed by the
+//! compiler.
+struct UartNoStats
+{
+	static const bool enabled = false;
+
+	inline void received (uint8_t) __attribute__((always_inline)) { }
+	inline void rxDropped () __attribute__((always_inline)) { }
+	inline void sent () __attribute__((always_inline)) { }
+	inline void txStall () __attribute__((always_inline)) { }
+	inline void rxLevel (uint8_t) __attribute__((always_inline)) { }
+	inline void txLevel (uint8_t) __attribute__((always_inline)) { }
+	inline void copy (uart_stats_t &) __attribute__((always_inline)) { }
+	inline void clear () __attribute__((always_inline)) { }
+};
+
+
+//! \brief Stands in for UartTimestamp when frames are not timed
+//! \details Every method does nothing so the timing is removed by the
+//! compiler.
+struct UartNoTimestamp
+{
+	static const bool enabled = false;
+	typedef uint16_t tick_t;
+
+	inline void received () __attribute__((always_inline)) { }
+	inline void consumed () __attribute__((always_inline)) { }
+	inline void clear () __attribute__((always_inline)) { }
+
+	template <class TPORT>
+	inline uint8_t readFrame (TPORT &, uint8_t *, uint8_t, tick_t &) { return 0; }
+};
+
+
+//! \brief Line discipline passing received bytes straight to getch()
+//! \details getch() does not wait; it returns _FDEV_EOF when nothing has
+//! been received.  putch() sends a newline as CR LF.  The default.
+struct UartRaw
+{
+	template <class TPORT>
+	__attribute__ ((always_inline)) inline int getch (TPORT & port, FILE *)
+	{
+		if (!port.available())
+			return _FDEV_EOF;
+		return port.read();
+	}
+
+	template <class TPORT>
+	__attribute__ ((always_inline)) inline int putch (TPORT & port, char c, FILE *)
+	{
+		if (c == '\a')
+		{
+			fputs("*ring*\n", stderr);
+			return 0;
+		}
+
+		if (c == '\n')
+			port.write('\r');
+
+		port.write(c);
+		return c;
+	}
+};
+
+
+//! \brief Line discipline with no translation in either direction
+//! \details getch() waits for each byte, so fread() and fwrite() can be
+//! used on the stream.  No buffer is needed.
+struct UartBinary
+{
+	template <class TPORT>
+	__attribute__ ((always_inline)) inline int getch (TPORT & port, FILE *)
+	{
+		return port.read();
+	}
+
+	template <class TPORT>
+	__attribute__ ((always_inline)) inline int putch (TPORT & port, char c, FILE *)
+	{
+		port.write(c);
+		return c;
+	}
+};
+
+
+//! \brief Line discipline with a simple line editor
+//! \details getch() allows the characters entered to be deleted and
+//! re-edited until either CR or NL is entered.  Printable characters are
+//! echoed using putch(), which behaves as UartRaw.
+//!
+//! Editing characters:
+//!
+//! . \b (BS) or \177 (DEL) delete the previous character
+//! . ^u kills the entire input buffer
+//! . ^w deletes the previous word
+//! . ^r sends a CR, and then reprints the buffer
+//! . \t will be replaced by a single space
+//!
+//! All other control characters will be ignored.
+//!
+//! The line buffer is SIZE characters long, which includes the terminating
+//! \n (but no terminating \0).  If the buffer is full (i. e., at SIZE-1
+//! characters in order to keep space for the trailing \n), any further
+//! input attempts will send a \a to putch() (BEL character), although line
+//! editing is still allowed.
+//!
+//! A receive error, such as a framing error caused by a serial line
+//! "break" condition, an overrun or a parity error, causes an immediate
+//! return of _FDEV_ERR.  With a receive queue errors are only seen with the
+//! rxErrors option.  ^c also returns _FDEV_ERR.
+//!
+//! Successive calls to getch() will be satisfied from the buffer until
+//! that buffer is emptied again.
+//! \tparam SIZE The size of the line buffer
+template <uint8_t SIZE = 80>
+class UartCooked : public UartRaw
+{
+private:
+	char buffer [SIZE];
+	char * next;			// the next character to return, or 0 to read a line
+
+public:
+	inline UartCooked () __attribute__((always_inline)) : next(0) { }
+
+	template <class TPORT>
+	int getch (TPORT & port, FILE * stream)
+	{
+		uint8_t c;
+		char *cp, *cp2;
+
+		if (next == 0)
+			for (cp = buffer;;)
+			{
+				bool error;
+				c = port.receive (error);
+				if (error)
+					return _FDEV_ERR;
+
+				/* behaviour similar to Unix stty ICRNL */
+				if (c == '\r')
+					c = '\n';
+				if (c == '\n')
+				{
+					*cp = c;
+					putch(port, c, stream);
+					next = buffer;
+					break;
+				}
+				else if (c == '\t')
+					c = ' ';
+
+				if ((c >= (uint8_t)' ' && c <= (uint8_t)'\x7e') || c >= (uint8_t)'\xa0')
+				{
+					if (cp == buffer + SIZE - 1)
+						putch(port, '\a', stream);
+					else
+					{
+						*cp++ = c;
+						putch(port, c, stream);
+					}
+					continue;
+				}
+
+				switch (c)
+				{
+					case 'c' & 0x1f:
+						return _FDEV_ERR;
+
+					case '\b':
+					case '\x7f':
+						if (cp > buffer)
+						{
+							putch(port, '\b', stream);
+							putch(port, ' ', stream);
+							putch(port, '\b', stream);
+							cp--;
+						}
+						break;
+
+					case 'r' & 0x1f:
+						putch(port, '\r', stream);
+						for (cp2 = buffer; cp2 < cp; cp2++)
+							putch(port, *cp2, stream);
+						break;
+
+					case 'u' & 0x1f:
+						while (cp > buffer)
+						{
+							putch(port, '\b', stream);
+							putch(port, ' ', stream);
+							putch(port, '\b', stream);
+							cp--;
+						}
+						break;
+
+					case 'w' & 0x1f:
+						while (cp > buffer && cp[-1] != ' ')
+						{
+							putch(port, '\b', stream);
+							putch(port, ' ', stream);
+							putch(port, '\b', stream);
+							cp--;
+						}
+						break;
+				}
+			}
+
+		c = *next++;
+		if (c == '\n')
+			next = 0;
+
+		return c;
+	}
+};
+
+
+//! \brief One bit for each UART, set while its receive queue holds data
+//! \details Bit n belongs to UARTn.  Maintained by the receive interrupt and
+//! the read methods of each Uart with a receive queue and the rxPending
+//! option, see UartSet.
+volatile uint8_t uartRxPending;
+
+
+//! \brief The default options for the Uart template class
+//! \details To change an option derive a new structure from this one and
+//! hide the member concerned, for example:
+//! \code
+//! struct LogOptions : UartOptions
+//! {
+//! 	static const uart_txfull_t txFull = txFullDrop;
+//! };
+//! Uart<UART1, 0, 64, LogOptions> logPort;
+//! \endcode
+struct UartOptions
+{
+	//! \brief Action taken by write() when the transmit queue is full
+	static const uart_txfull_t txFull = txFullBlock;
+
+	//! \brief Enables the multiprocessor communication mode support, see
+	//! Uart::setAddress()
+	static const bool multiprocessor = false;
+
+	//! \brief Keeps a bit with each byte in the receive queue recording
+	//! whether it arrived with a framing, overrun or parity error, see
+	//! Uart::read(bool &)
+	static const bool rxErrors = false;
+
+	//! \brief The throughput and error counters, UartStats to keep them,
+	//! see Uart::snapshot()
+	typedef UartNoStats stats;
+
+	//! \brief A Crc16 kept over every byte received, see Uart::getRxCrc()
+	typedef NoCrc rxCrc;
+
+	//! \brief A Crc16 kept over every byte sent, see Uart::getTxCrc()
+	typedef NoCrc txCrc;
+
+	//! \brief Records the arrival time of each frame, a UartTimestamp, see
+	//! Uart::readFrame()
+	typedef UartNoTimestamp timestamp;
+
+	//! \brief The line discipline used by getch() and putch(), UartRaw,
+	//! UartCooked or UartBinary
+	typedef UartRaw discipline;
+
+	//! \brief The RS-485 driver enable output, a FastIOOutputPin, see
+	//! Uart::txCompleteIsr()
+	typedef UartNoPin dePin;
+
+	//! \brief The RTS output, a FastIOOutputPin, driven low while the
+	//! receive queue can take more data
+	typedef UartNoPin rtsPin;
+
+	//! \brief The CTS input, a FastIOInputPin; data is only sent while it
+	//! is low
+	typedef UartNoPin ctsPin;
+
+	//! \brief Number of bytes in the receive queue at which RTS is released,
+	//! or zero for three quarters of the queue.  Leave room for the bytes
+	//! the sender has already committed to, such as the contents of its FIFO.
+	static const uint8_t rtsHigh = 0;
+
+	//! \brief Number of bytes in the receive queue at or below which RTS is
+	//! asserted again, or zero for a quarter of the queue
+	static const uint8_t rtsLow = 0;
+
+	//! \brief Puts the CPU into idle sleep while read() waits for the
+	//! receive queue or write() for room in the transmit queue.  The
+	//! interrupt that ends the wait wakes it.  Has no effect in polled mode.
+	static const bool sleepWait = false;
+
+	//! \brief Keeps this port's bit in uartRxPending up to date for
+	//! UartSet::pending().  Costs an atomic update of the bit each time a
+	//! byte is queued or read.  Has no effect in polled mode.
+	static const bool rxPending = false;
+};
+
+
 
 //! \brief A template class to wrap the UART
 //! \details A class that allows consistent high and low level operations
 //! with the UART hardware onboard an Atmel 8 bit Mega and Tiny MCU
+//! \par Buffered receive
+//! When RXSIZE is non zero the receive complete interrupt is enabled by init()
+//! and each byte is moved from UDR into a queue of that size, so nothing is
+//! lost while the main line code is busy.  The application must connect the
+//! interrupt vector to the object:
+//! \code
+//! Uart<UART0, 64> serial;
+//! ISR(USART0_RX_vect) { serial.rxCompleteIsr(); }
+//! \endcode
+//! \par Buffered transmit
+//! When TXSIZE is non zero write() places the byte in a queue of that size
+//! and returns.  The data register empty interrupt sends the queued bytes and
+//! disables itself once the queue is empty.  What happens when the queue is
+//! full is set by the txFull member of TOPTIONS.
+//! \code
+//! ISR(USART0_UDRE_vect) { serial.dataEmptyIsr(); }
+//! \endcode
+//! The predefined uart0 to uart3 objects are sized by UART0_RXSIZE,
+//! UART0_TXSIZE to UART3_RXSIZE, UART3_TXSIZE, which may be defined before
+//! this file is included.
+//! \par Multiprocessor communication mode
+//! With the multiprocessor option set the UART uses 9 bit frames, the ninth
+//! bit marking a frame as an address.  Once setAddress() has been called the
+//! hardware ignores data frames until an address frame arrives; the receive
+//! handler compares it with the node address and either clears MPCM, so the
+//! data that follows is received, or sets it again, so that no interrupt is
+//! raised for data sent to other nodes.  Address frames are not passed on.
+//! \code
+//! struct BusOptions : UartOptions
+//! {
+//! 	static const bool multiprocessor = true;
+//! };
+//! Uart<UART1, 32, 0, BusOptions> bus;
+//! bus.init();
+//! bus.setBaud<F_CPU, 250000>();
+//! bus.setAddress(12);
+//!
+//! bus.writeAddress(7);			// master: select node 7
+//! bus.write(command, length);
+//! \endcode
+//! \par RS-485 driver enable
+//! When TOPTIONS names a dePin the pin is driven high as each byte is written
+//! to UDR, and low again by the transmit complete interrupt once the stop bit
+//! of the last byte has left the shift register.  The interrupt is enabled by
+//! init(), and the application connects the vector:
+//! \code
+//! struct Rs485Options : UartOptions
+//! {
+//! 	typedef FastIOOutputPin<FASTIOPIN_D2> dePin;
+//! };
+//! Uart<UART1, 32, 32, Rs485Options> bus;
+//! ISR(USART1_TX_vect) { bus.txCompleteIsr(); }
+//! \endcode
+//! \par Flow control
+//! With an rtsPin the receive interrupt drives RTS high once the receive
+//! queue holds rtsHigh bytes, and read() drives it low again when the queue
+//! has drained to rtsLow.  With a ctsPin the data register empty interrupt
+//! stops sending while CTS is high; connect the pin change interrupt of the
+//! CTS pin to ctsChangeIsr() so sending restarts without polling:
+//! \code
+//! struct PiOptions : UartOptions
+//! {
+//! 	typedef FastIOOutputPin<FASTIOPIN_D4> rtsPin;
+//! 	typedef FastIOInputPin<FASTIOPIN_B4> ctsPin;
+//! };
+//! Uart<UART1, 64, 64, PiOptions> pi;
+//! PinChangeInt<PCINT0_7, _BV(PCINT4)> ctsInt;
+//! ISR(USART1_RX_vect) { pi.rxCompleteIsr(); }
+//! ISR(USART1_UDRE_vect) { pi.dataEmptyIsr(); }
+//! ISR(PCINT0_vect) { pi.ctsChangeIsr(); }
+//! \endcode
+//! \par Receive errors
+//! isFrameError() and isOverrun() only describe the byte now in UDR.  With
+//! the rxErrors option the receive interrupt also records, in a bitmap beside
+//! the queue costing one byte per eight slots, whether each byte arrived with
+//! an error; read(bool &) and peekError() return it.
+//! \par Counters
+//! With stats set to UartStats the object counts the bytes in and out, the
+//! receive errors of each kind, the bytes lost to a full receive queue, the
+//! writes that found the transmit queue full and the high water mark of each
+//! queue.  snapshot() copies them.  The default UartNoStats costs nothing.
+//! \par Checksums
+//! With rxCrc or txCrc set to a Crc16 the CRC is added to as each byte is
+//! received or sent, in the interrupt when the queues are used, so it is
+//! ready as soon as the last byte of a frame is through:
+//! \code
+//! struct CheckedOptions : UartOptions
+//! {
+//! 	typedef Crc16<CrcXmodem, CrcTable> rxCrc;
+//! };
+//! Uart<UART0, 64, 0, CheckedOptions> link;
+//!
+//! link.resetRxCrc();
+//! // ... read the frame and its CRC
+//! if (link.getRxCrc() == 0) ...
+//! \endcode
 //! \tparam TUART One of the predefined objects UART_0, UART_1, UART_2 or UART_3
+//! \tparam RXSIZE Size of the receive queue, a power of two up to 128, or
+//! zero (the default) to read directly from the hardware
+//! \tparam TXSIZE Size of the transmit queue, a power of two up to 128, or
+//! zero (the default) to write directly to the hardware
+//! \tparam TOPTIONS A structure derived from UartOptions
 //! \note Not all UARTS are available on every platform.
-template <class TUART>
+template <class TUART, uint8_t RXSIZE = 0, uint8_t TXSIZE = 0, class TOPTIONS = UartOptions>
 class Uart
 {
 public:
 protected:
 private:
-	char rxbuf [MAX_UARTBUF];
+	RingBuffer<RXSIZE, TOPTIONS::rxErrors> rxQueue;
+	RingBuffer<TXSIZE> txQueue;
+	volatile bool txWritten;
+	uint8_t nodeAddress;
+	typename TOPTIONS::dePin dePin;
+	typename TOPTIONS::stats stats;
+	typename TOPTIONS::rxCrc rxCrc;
+	typename TOPTIONS::txCrc txCrc;
+	typename TOPTIONS::discipline line;
+	typename TOPTIONS::timestamp stamps;
+	typename TOPTIONS::rtsPin rtsPin;
+	typename TOPTIONS::ctsPin ctsPin;
+
+	static const bool hasRts = UartHasPin<typename TOPTIONS::rtsPin>::value;
+	static const uint8_t rtsHigh = TOPTIONS::rtsHigh ? TOPTIONS::rtsHigh : RXSIZE - RXSIZE / 4;
+	static const uint8_t rtsLow = TOPTIONS::rtsLow ? TOPTIONS::rtsLow : RXSIZE / 4;
+	static_assert(!hasRts || (RXSIZE && rtsHigh <= RXSIZE && rtsHigh >= rtsLow + 2),
+		"RTS needs a receive queue and rtsHigh at least two above rtsLow");
 
 public:
 	//! \brief Initialises a new instance of the uart class
-	inline Uart () __attribute__((always_inline)) { }
+	//! \details RTS, if used, is held high until init() is called
+	inline Uart () __attribute__((always_inline)) : rtsPin(true) { }
 	
 	//! \brief Initialises the UART enabling RX and TX and set to
 	//! 8 bits, 1 stop, no parity
+	//! \details When a receive queue is in use the receive complete interrupt
+	//! is also enabled, as is the transmit complete interrupt when there is a
+	//! driver enable pin.  Global interrupts must be enabled by the caller.
 	inline void init() __attribute__((always_inline))
 	{
-		enableRx();
-		enableTx();
-		setDataBits(databit8);
-		setParity(parityNone);
+		enableRx();
+		enableTx();
+		setDataBits(databit8);
+		setParity(parityNone);
+		if (RXSIZE)
+			enableRxInt();
+		if (UartHasPin<typename TOPTIONS::dePin>::value)
+			enableTxInt();
+		rtsPin.clear();
+	}
+
+
+	//! \brief Enables the receiver
+	inline void enableRx () __attribute__((always_inline))
+	{
+		//*psfr8_t (TUART::crsbx) |= _BV(RXEN0);
+		_sbi(*psfr8_t (TUART::crsbx), RXEN0);
+	}
+
+
+	//! \brief Enables the transmitter
+	inline void enableTx() __attribute__((always_inline))
+	{
+		//*psfr8_t (TUART::crsbx) |= _BV(TXEN0);
+		_sbi(*psfr8_t (TUART::crsbx), TXEN0);
+	}
+
+
+	//! \brief Enables the receive byte interrupt
+	//! \details The receive interrupt is raised when there is unread data
+	//! in the receive buffer
+	inline void enableRxInt() __attribute__((always_inline))
+	{
+		*psfr8_t (TUART::crsbx) |= _BV(RXCIE0);
+	}
+
+
+	//! \brief Disables the receive byte interrupt
+	inline void disableRxInt() __attribute__((always_inline))
+	{
+		*psfr8_t (TUART::crsbx) &= ~_BV(RXCIE0);
+	}
+
+
+	//! \brief Enable the transmit byte interrupt
+	//! \details The transmit interrupt is raised when the frame has been
+	//! shifted out and there is no data in the transmit buffer
+	inline void enableTxInt() __attribute__((always_inline))
+	{
+		*psfr8_t (TUART::crsbx) |= _BV(TXCIE0);
+	}
+
+
+	//! \brief Disables the transmit byte interrupt
+	inline void disableTxInt() __attribute__((always_inline))
+	{
+		*psfr8_t (TUART::crsbx) &= ~_BV(TXCIE0);
+	}
+
+
+	//! \brief Enables the transmitter buffer empty interrupt
+	//! \details The buffer empty interrupt is raised when the transmit
+	//! buffer can accept new data
+	inline void enableTxEmptyInt() __attribute__((always_inline))
+	{
+		*psfr8_t (TUART::crsbx) |= _BV(UDRIE0);
+	}
+
+
+	//! \brief Disables the transmitter buffer empty interrupt
+	inline void disableTxEmptyInt() __attribute__((always_inline))
+	{
+		*psfr8_t (TUART::crsbx) &= ~_BV(UDRIE0);
+	}
+
+
+	//! \brief Indicates if the transmitter is ready
+	//!
+	//! \return true if the transmit buffer is empty and can accept a new character
+	inline
+	bool txReady() __attribute__((always_inline)) __attribute__((always_inline))
+	{
+		return bit_is_set(*psfr8_t (TUART::crsax), UDRE0);
+	}
+
+
+	//! \brief Writes the supplied byte to the UART
+	//! \details The method will block whilst any previous byte
+	//! is sent and the transmitter buffer is not ready.  With a transmit
+	//! queue the byte is queued instead and the method only blocks if the
+	//! queue is full and the txFull option is txFullBlock.
+	//! \param data The data byte to write
+	void write (uint8_t data)
+	{
+		if (TXSIZE)
+		{
+			// nothing waiting and the transmitter is free, so skip the queue
+			if (txQueue.isEmpty() && txReady() && isCtsActive())
+			{
+				writeData(data);
+				return;
+			}
+
+			queueData(data);
+			enableTxEmptyInt();
+			return;
+		}
+
+		while (!txReady() || !isCtsActive())
+			;
+
+		writeData(data);
+	}
+
+
+	//! \brief Writes an array of bytes to the UART
+	//! \param data Pointer to the bytes to write
+	//! \param count The number of bytes to write
+	void write (const uint8_t * data, uint8_t count)
+	{
+		while (count--)
+			write (*data++);
+	}
+
+
+	//! \brief Writes an array of bytes held in flash to the UART
+	//! \details Each byte is read from program memory and passed straight to
+	//! the transmitter, or the transmit queue if one is in use, without being
+	//! copied to RAM first.
+	//! \code
+	//! static const uint8_t table[] PROGMEM = { 0x01, 0x02, 0x04, 0x08 };
+	//! uart0.writeP(table, sizeof(table));
+	//! \endcode
+	//! \param data Pointer to the bytes in program memory
+	//! \param count The number of bytes to write
+	void writeP (const uint8_t * data, uint16_t count)
+	{
+		while (count--)
+			write (pgm_read_byte (data++));
+	}
+
+
+	//! \brief Writes a nul terminated string held in flash to the UART
+	//! \details The characters are sent as they are, without the newline
+	//! and bell handling performed by putch().
+	//! \code
+	//! uart0.printP(PSTR("Ready\r\n"));
+	//! \endcode
+	//! \param str Pointer to the string in program memory
+	void printP (PGM_P str)
+	{
+		char c;
+		while ((c = pgm_read_byte (str++)) != '\0')
+			write (c);
+	}
+
+
+	//== PRINT ==
+	//! \brief Prints each argument in turn
+	//! \details The format of each argument is chosen at compile time from its
+	//! type: char as a character, other integers in decimal, char pointers as
+	//! strings in RAM, F() strings from flash, and dec(), hex() and fixed() as
+	//! described in uartformat.h.  The output goes through write() so it uses
+	//! the transmit queue when there is one.  No newline translation is done.
+	//! \code
+	//! uart0.print(F("T="), fixed<1>(temp), F(" P="), hex<4>(p));
+	//! \endcode
+	template <typename T1, typename T2, typename... TREST>
+	inline void print (T1 first, T2 second, TREST... rest)
+	{
+		print (first);
+		print (second, rest...);
+	}
+
+
+	//! \brief Prints the arguments followed by CR LF
+	template <typename... TARGS>
+	inline void println (TARGS... args)
+	{
+		print (args...);
+		write ('\r');
+		write ('\n');
+	}
+
+
+	//! \brief Prints nothing; ends the recursion of the other print methods
+	inline void print () __attribute__((always_inline)) { }
+
+	//! \brief Prints a character
+	inline void print (char c) __attribute__((always_inline)) { write (c); }
+
+	//! \brief Prints a nul terminated string held in RAM
+	void print (const char * str)
+	{
+		char c;
+		while ((c = *str++) != '\0')
+			write (c);
+	}
+
+	//! \brief Prints a nul terminated string held in flash, see F()
+	inline void print (const FlashString * str) __attribute__((always_inline))
+	{
+		printP (reinterpret_cast<PGM_P> (str));
+	}
+
+	//! \brief Prints an integer in decimal
+	inline void print (signed char value) __attribute__((always_inline)) { print (dec (value)); }
+	inline void print (unsigned char value) __attribute__((always_inline)) { print (dec (value)); }
+	inline void print (short value) __attribute__((always_inline)) { print (dec (value)); }
+	inline void print (unsigned short value) __attribute__((always_inline)) { print (dec (value)); }
+	inline void print (int value) __attribute__((always_inline)) { print (dec (value)); }
+	inline void print (unsigned int value) __attribute__((always_inline)) { print (dec (value)); }
+	inline void print (long value) __attribute__((always_inline)) { print (dec (value)); }
+	inline void print (unsigned long value) __attribute__((always_inline)) { print (dec (value)); }
+
+	//! \brief Prints an integer in decimal with a width and pad character
+	template <typename T, uint8_t WIDTH, char PAD>
+	inline void print (UartDec<T, WIDTH, PAD> f)
+	{
+		typedef UartInt<T> info;
+		printNumber<typename info::utype> (info::magnitude(f.value), info::negative(f.value), WIDTH, PAD, 0);
+	}
+
+	//! \brief Prints a scaled integer with a decimal point
+	template <typename T, uint8_t DECIMALS, uint8_t WIDTH, char PAD>
+	inline void print (UartFixed<T, DECIMALS, WIDTH, PAD> f)
+	{
+		typedef UartInt<T> info;
+		static_assert(DECIMALS < sizeof(typename info::utype) * 2 + 1, "Too many decimal places for the type");
+		printNumber<typename info::utype> (info::magnitude(f.value), info::negative(f.value), WIDTH, PAD, DECIMALS);
+	}
+
+	//! \brief Prints an integer in hexadecimal with a width and pad character
+	template <typename T, uint8_t WIDTH, char PAD>
+	inline void print (UartHex<T, WIDTH, PAD> f)
+	{
+		typedef typename UartInt<T>::utype utype;
+		const utype mask = utype(~utype(0)) >> (8 * (sizeof(utype) - sizeof(T)));
+		printHex<utype> (utype(f.value) & mask, WIDTH, PAD);
+	}
+
+
+	//! \brief Waits until all data has been transmitted
+	//! \details Blocks until the transmit queue is empty and the last
+	//! stop bit has left the shift register
+	void flush ()
+	{
+		if (!txWritten)
+			return;
+
+		while (!txQueue.isEmpty())
+			serviceTx();
+
+		// txCompleteIsr() clears the TXC flag along with txWritten
+		while (txWritten && bit_is_clear (*psfr8_t (TUART::crsax), TXC0))
+			;
+	}
+
+
+	//! \brief Gets the number of bytes that can be written without blocking
+	inline uint8_t availableForWrite () __attribute__((always_inline))
+	{
+		if (TXSIZE)
+			return txQueue.space();
+
+		return txReady() ? 1 : 0;
+	}
+
+
+	//! \brief Data register empty interrupt handler
+	//! \details Call from the USARTn_UDRE_vect interrupt routine when a
+	//! transmit queue is in use.  Sends the next queued byte and disables
+	//! the interrupt when the queue is empty.
+	inline void dataEmptyIsr () __attribute__((always_inline))
+	{
+		// paused until ctsChangeIsr() sees CTS return
+		if (!isCtsActive())
+		{
+			disableTxEmptyInt();
+			return;
+		}
+
+		if (!txQueue.isEmpty())
+			writeData (txQueue.get());
+
+		if (txQueue.isEmpty())
+			disableTxEmptyInt();
+	}
+
+
+	//! \brief Transmit complete interrupt handler
+	//! \details Call from the USARTn_TX_vect interrupt routine when a dePin
+	//! is used.  Releases the RS-485 bus by driving the pin low.  The flag is
+	//! cleared before every byte is written, so the interrupt is only raised
+	//! after the last byte of a burst, or in a gap between bytes if the
+	//! application cannot keep the transmitter busy; the next write() then
+	//! drives the pin high again.
+	//! \par Turnaround
+	//! Counted from the instruction timings, not measured on a part, the pin
+	//! goes low about 20 cycles after the end of the stop bit: 4 (5 on
+	//! devices with more than 128K of flash) to enter the interrupt, 3 for the
+	//! vector jump, about 10 for the prologue and 2 for the cbi, or 5 where the
+	//! port is above the I/O space (ports H to L on the ATmega2560).  That is
+	//! 1.3us at 16MHz, plus the run time of any interrupt that is in progress.
+	//! Going the other way the pin is driven high 2 to 5 cycles before UDR is
+	//! written, and the start bit follows within one bit time.
+	inline void txCompleteIsr () __attribute__((always_inline))
+	{
+		dePin.clear();
+		txWritten = false;
+	}
+
+
+	//! \brief CTS pin change interrupt handler
+	//! \details Call from the PCINTn_vect interrupt routine of the group
+	//! holding the ctsPin.  Restarts sending when CTS goes low; calling it
+	//! for changes of other pins in the group does no harm.
+	inline void ctsChangeIsr () __attribute__((always_inline))
+	{
+		if (isCtsActive() && !txQueue.isEmpty())
+			enableTxEmptyInt();
+	}
+
+
+	//! \brief Checks is the receiver has a byte ready
+	//! \details When a byte is received from the port it is transferred in
+	//! a buffer register and the ready flag is set
+	//! \return true is the receiver has received a new byte
+	inline
+	bool rxReady() __attribute__((always_inline))
+	{
+		return bit_is_set (*psfr8_t (TUART::crsax), RXC0);
+	}
+
+
+	//! \brief Gets the number of received bytes waiting to be read
+	//! \details With a receive queue this is the number of bytes in the queue,
+	//! otherwise it is one if the receiver has a byte ready
+	//! \return The number of bytes that can be read without blocking
+	inline
+	uint8_t available () __attribute__((always_inline))
+	{
+		if (RXSIZE)
+			return rxQueue.count();
+
+		return rxReady() ? 1 : 0;
+	}
+
+
+	//! \brief Reads a byte from the UART
+	//! \details Blocks until a byte has been read from the port and is available
+	//! in the receiver buffer.  With a receive queue the byte is taken from the
+	//! queue and the hardware is never polled.
+	//! \return The data byte received
+	uint8_t read ()
+	{
+		if (RXSIZE)
+		{
+			while (rxQueue.isEmpty())
+				idle<true>();
+
+			uint8_t data = rxQueue.get();
+			stamps.consumed();
+			dequeued();
+			return data;
+		}
+
+		uint8_t data, status;
+		do
+		{
+			while (!rxReady())
+				;
+		} while (!receiveData (data, status));
+
+		return data;
+	}
+
+
+	//! \brief Reads a byte from the UART and reports if it was corrupted
+	//! \details As read(), but also returns the receive error state for the
+	//! byte.  With a receive queue this was recorded by the interrupt when the
+	//! byte arrived, so a parser can drop a damaged frame long after the
+	//! hardware flags have moved on.  Needs the rxErrors option when a
+	//! receive queue is used.
+	//! \param error Set true if the byte had a framing or parity error, or
+	//! if data was lost to an overrun just before it
+	//! \return The data byte received
+	uint8_t read (bool & error)
+	{
+		static_assert(!RXSIZE || TOPTIONS::rxErrors, "read(bool &) needs the rxErrors option");
+
+		return receive (error);
+	}
+
+
+	//! \brief Reads a byte and reports a receive error where one is known
+	//! \details As read(bool &) but also allowed with a receive queue and no
+	//! rxErrors option, when error is always false.  Used by the line
+	//! disciplines.
+	//! \param error Set true if the byte had a framing or parity error, or
+	//! if data was lost to an overrun just before it
+	//! \return The data byte received
+	uint8_t receive (bool & error)
+	{
+		if (RXSIZE)
+		{
+			while (rxQueue.isEmpty())
+				idle<true>();
+
+			error = rxQueue.peekTag();
+			uint8_t data = rxQueue.get();
+			stamps.consumed();
+			dequeued();
+			return data;
+		}
+
+		uint8_t data, status;
+		do
+		{
+			while (!rxReady())
+				;
+		} while (!receiveData (data, status));
+
+		error = status != 0;
+		return data;
+	}
+
+
+	//! \brief Reads a frame and the time its first byte arrived
+	//! \details Needs a receive queue and a UartTimestamp as the timestamp
+	//! option, which marks the first byte after each idle gap as the start of
+	//! a frame.  Bytes before the next frame start are discarded, then the
+	//! frame is read until the following frame starts or the line has been
+	//! idle for the gap.  Any part of the frame that does not fit the
+	//! buffer is discarded.
+	//! \param buffer Receives the frame
+	//! \param size The size of the buffer
+	//! \param time Receives the timer count latched by the receive interrupt
+	//! when the first byte arrived
+	//! \return The number of bytes in the frame
+	uint8_t readFrame (uint8_t * buffer, uint8_t size, typename TOPTIONS::timestamp::tick_t & time)
+	{
+		static_assert(RXSIZE && TOPTIONS::timestamp::enabled, "readFrame needs a receive queue and a UartTimestamp");
+
+		return stamps.readFrame (*this, buffer, size, time);
+	}
+
+
+	//! \brief Indicates if the next byte to be read was received with an error
+	//! \details Only meaningful with the rxErrors option and a receive queue
+	//! that is not empty.
+	inline bool peekError () __attribute__((always_inline))
+	{
+		return rxQueue.peekTag();
+	}
+
+
+	//! \brief Copies the counters
+	//! \details The copy is made with interrupts disabled so the counters
+	//! are consistent with each other.  Needs stats to be UartStats in TOPTIONS:
+	//! \code
+	//! struct CountedOptions : UartOptions
+	//! {
+	//! 	typedef UartStats stats;
+	//! };
+	//! \endcode
+	//! \param copy Receives the counters
+	//! \param clear True to zero the counters once copied
+	void snapshot (uart_stats_t & copy, bool clear = false)
+	{
+		static_assert(TOPTIONS::stats::enabled, "snapshot needs UartStats in the options");
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			stats.copy (copy);
+			if (clear)
+				stats.clear();
+		}
+	}
+
+
+	//! \brief Gets the CRC of the bytes received since resetRxCrc()
+	//! \details Needs rxCrc in TOPTIONS.  With a receive queue this includes
+	//! bytes that are still waiting to be read.
+	inline uint16_t getRxCrc () __attribute__((always_inline))
+	{
+		static_assert(TOPTIONS::rxCrc::enabled, "getRxCrc needs a Crc16 as rxCrc in the options");
+
+		uint16_t value;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			value = rxCrc.value();
+		}
+		return value;
+	}
+
+
+	//! \brief Starts a new receive CRC
+	//! \details Call before the first byte of the frame arrives, or discard
+	//! the receive queue at the same time with flushRx().
+	inline void resetRxCrc () __attribute__((always_inline))
+	{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			rxCrc.reset();
+		}
 	}
 
 
-	//! \brief Enables the receiver
-	inline void enableRx () __attribute__((always_inline))
+	//! \brief Gets the CRC of the bytes sent since resetTxCrc()
+	//! \details Needs txCrc in TOPTIONS.  With a transmit queue only the
+	//! bytes that have left the queue are included; call flush() first to
+	//! be sure of having them all.
+	inline uint16_t getTxCrc () __attribute__((always_inline))
 	{
-		//*psfr8_t (TUART::crsbx) |= _BV(RXEN0);
-		_sbi(*psfr8_t (TUART::crsbx), RXEN0);
+		static_assert(TOPTIONS::txCrc::enabled, "getTxCrc needs a Crc16 as txCrc in the options");
+
+		uint16_t value;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			value = txCrc.value();
+		}
+		return value;
 	}
 
 
-	//! \brief Enables the transmitter
-	inline void enableTx() __attribute__((always_inline))
+	//! \brief Starts a new transmit CRC
+	inline void resetTxCrc () __attribute__((always_inline))
 	{
-		//*psfr8_t (TUART::crsbx) |= _BV(TXEN0);
-		_sbi(*psfr8_t (TUART::crsbx), TXEN0);
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			txCrc.reset();
+		}
 	}
 
 
-	//! \brief Enables the receive byte interrupt
-	//! \details The receive interrupt is raised when there is unread data
-	//! in the receive buffer
-	inline void enableRxInt() __attribute__((always_inline))
+	//! \brief Discards any received bytes waiting in the receive queue
+	inline void flushRx () __attribute__((always_inline))
 	{
-		*psfr8_t (TUART::crsbx) |= _BV(RXCIE0);
+		// the frame times must stay in step with the queue
+		if (TOPTIONS::timestamp::enabled)
+		{
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+			{
+				rxQueue.clear();
+				stamps.clear();
+			}
+		}
+		else
+			rxQueue.clear();
+		dequeued();
 	}
 
 
-	//! \brief Enable the transmit byte interrupt
-	//! \details The transmit interrupt is raised when the frame has been
-	//! shifted out and there is no data in the transmit buffer
-	inline void enableTxInt() __attribute__((always_inline))
+	//! \brief Receive complete interrupt handler
+	//! \details Call from the USARTn_RX_vect interrupt routine when a receive
+	//! queue is in use.  The byte is moved from the data register into the
+	//! queue; if the queue is full the byte is discarded.
+	inline void rxCompleteIsr () __attribute__((always_inline))
 	{
-		*psfr8_t (TUART::crsbx) |= _BV(TXCIE0);
+		uint8_t data, status;
+		if (receiveData (data, status))
+		{
+			if (rxQueue.put (data, status != 0))
+			{
+				if (TOPTIONS::rxPending)
+					uartRxPending |= _BV(TUART::index);
+				stamps.received();
+			}
+			else
+				stats.rxDropped();
+			stats.rxLevel (rxQueue.count());
+
+			if (hasRts && rxQueue.count() >= rtsHigh)
+				rtsPin.set();
+		}
 	}
 
 
-	//! \brief Enables the transmitter buffer empty interrupt
-	//! \details The buffer empty interrupt is raised when the transmit
-	//! buffer can accept new data
-	inline void enableTxEmptyInt() __attribute__((always_inline))
+	//== MULTIPROCESSOR ==
+	//! \brief Sets the node address and waits for it to be selected
+	//! \details Selects 9 data bits and sets MPCM so that only address frames
+	//! are received until one carries this address.  Needs the multiprocessor
+	//! option; call after setBaud(), which clears MPCM.
+	//! \param address The address of this node
+	inline void setAddress (uint8_t address) __attribute__((always_inline))
 	{
-		*psfr8_t (TUART::crsbx) |= _BV(UDRIE0);
+		static_assert(TOPTIONS::multiprocessor, "setAddress needs the multiprocessor option");
+		nodeAddress = address;
+		setDataBits (databit9);
+		setMpcm (true);
 	}
 
 
-	//! \brief Indicates if the transmitter is ready
-	//!
-	//! \return true if the transmit buffer is empty and can accept a new character
-	inline
-	bool txReady() __attribute__((always_inline)) __attribute__((always_inline))
+	//! \brief Ignores further data frames until this node is addressed again
+	//! \details Call at the end of a message when its length is known, so
+	//! the rest of the bus traffic raises no interrupts.  Otherwise MPCM is
+	//! set again when the next address frame for another node arrives.
+	inline void waitForAddress () __attribute__((always_inline))
 	{
-		return bit_is_set(*psfr8_t (TUART::crsax), UDRE0);
+		setMpcm (true);
 	}
 
 
-	//! \brief Writes the supplied byte to the UART
-	//! \details The method will block whilst any previous byte
-	//! is sent and the transmitter buffer is not ready
-	//! \param data The data byte to write
-	void write (uint8_t data)
+	//! \brief Indicates if this node has been selected by an address frame
+	inline bool isAddressed () __attribute__((always_inline))
 	{
-		while (!txReady())
-			;
+		return bit_is_clear (*psfr8_t (TUART::crsax), MPCM0);
+	}
 
-		*psfr8_t (TUART::datax) = data;
+
+	//! \brief Sends an address frame to select a node
+	//! \details Waits for the transmit queue to empty as the ninth bit is
+	//! not queued.  The following write() calls send data frames.
+	//! \param address The address of the node to select
+	inline void writeAddress (uint8_t address) __attribute__((always_inline))
+	{
+		write9 (0x100 | address);
 	}
 
 
-	//! \brief Checks is the receiver has a byte ready
-	//! \details When a byte is received from the port it is transferred in
-	//! a buffer register and the ready flag is set
-	//! \return true is the receiver has received a new byte
-	inline
-	bool rxReady() __attribute__((always_inline))
+	//! \brief Writes a 9 bit frame
+	//! \details Waits for the transmit queue to empty and for the transmitter
+	//! to be ready, then writes the frame directly to the hardware.  Needs the
+	//! multiprocessor option, which makes write() clear the ninth bit again.
+	//! \param data The frame; bit 8 is sent as the ninth bit
+	void write9 (uint16_t data)
 	{
-		return bit_is_set (*psfr8_t (TUART::crsax), RXC0);
+		static_assert(TOPTIONS::multiprocessor, "write9 needs the multiprocessor option");
+
+		while (!txQueue.isEmpty())
+			serviceTx();
+
+		while (!txReady())
+			;
+
+		writeData (data, data & 0x100);
 	}
 
 
-	//! \brief Reads a byte from the UART
-	//! \details Blocks until a byte has been read from the port and is available
-	//! in the receiver buffer
-	//! \return The data byte received
-	uint8_t read ()
+	//! \brief Reads a 9 bit frame from the hardware
+	//! \details Blocks until a frame is received.  Only for use without a
+	//! receive queue; address frames are not filtered.
+	//! \return The frame, with the ninth bit in bit 8
+	uint16_t read9 ()
 	{
 		while (!rxReady())
 			;
-		
-		return *psfr8_t (TUART::datax);
+
+		// RXB8 must be read before UDR
+		uint16_t data = bit_is_set (*psfr8_t (TUART::crsbx), RXB80) ? 0x100 : 0;
+		return data | *psfr8_t (TUART::datax);
 	}
 
 
@@ -214,156 +1429,93 @@ public:
 	
 	//== BAUDRATE ==
 	//! \brief Sets the baudrate
-	//! \details This method and the setBaudX methods all
-	//! use the AVR CLIB setbaud.h file to determine the
-	//! baudrate settings.   To use this method, the programmer must
-	//! #define \c BAUD to the required baudrate.  The header file
-	//! generates values for the baudrate register and clock doubler
-	//! bit.  The other baudrate setting methods use the same method 
-	//! except that the process is hidden from the programmer.
-	//! \warning If the baudrate cannot be acheived from the clock speed or
-	//! the actual baudrate would be out of limits of accuracy the file
-	//! will generate a warning
-	inline void setBaud () __attribute__ ((always_inline))
+	//! \details The settings are calculated at compile time by UartBaud, choosing
+	//! the clock doubler only where it gives a lower error.  A rate that cannot
+	//! be reached within UART_BAUD_TOL fails to compile.  Only the
+	//! baudrate register and UCSRnA are written.
+	//! \tparam FCPU The CPU clock frequency, normally F_CPU
+	//! \tparam RATE The required baudrate
+	//! \note Multiprocessor communication mode is cleared
+	template <uint32_t FCPU, uint32_t RATE>
+	__attribute__ ((always_inline)) inline void setBaud ()
 	{
-		#ifndef BAUD
-		#define BAUD 9600
-		#endif
-		#include <util/setbaud.h>
-		*psfr16_t (TUART::ubrrx) = UBRR_VALUE;
-		#if USE_2X
-		*psfr8_t(TUART::crsax) |= _BV(U2X0);
-		#else
-		*psfr8_t(TUART::crsax) &= ~_BV(U2X0);
-		#endif
+		typedef UartBaud<FCPU, RATE> baud;
+		static_assert(baud::reachable, "Baudrate is out of range for this clock");
+		static_assert(baud::valid, "Baudrate error exceeds UART_BAUD_TOL");
+
+		*psfr16_t (TUART::ubrrx) = baud::ubrr;
+		*psfr8_t (TUART::crsax) = baud::use2x ? _BV(U2X0) : 0;
 	}
 
 
-	//! \brief Sets the baudrate to 300
-	inline void setBaud300 () __attribute__ ((always_inline))
-	{
-		#undef BAUD
-		#define BAUD 300
-		#include <util/setbaud.h>
-		*psfr16_t (TUART::ubrrx) = UBRR_VALUE;
-		#if USE_2X
-		*psfr8_t(TUART::crsax) |= _BV(U2X0);
-		#else
-		*psfr8_t(TUART::crsax) &= ~_BV(U2X0);
-		#endif
+	//! \brief Sets the baudrate at run time
+	//! \details Looks the rate up in a table of standard rates that was
+	//! calculated for F_CPU at compile time, so no division is performed.
+	//! \param rate The required baudrate, one of the rates in UartBaudTable
+	//! \returns True if the rate was set; false if it is not in the table or
+	//! cannot be reached from F_CPU, in which case the baudrate is unchanged.
+	//! \note Multiprocessor communication mode is cleared
+	bool setBaud (uint32_t rate)
+	{
+		typedef UartBaudTable<F_CPU> table;
+		const uart_baud_t * entry = table::entries;
+
+		for (uint8_t i = 0; i < table::count; i++, entry++)
+		{
+			if (pgm_read_dword (&entry->rate) == rate)
+			{
+				uint16_t setting = pgm_read_word (&entry->setting);
+				if (setting == UART_BAUD_INVALID)
+					return false;
+
+				*psfr16_t (TUART::ubrrx) = setting & ~UART_BAUD_2X;
+				*psfr8_t (TUART::crsax) = (setting & UART_BAUD_2X) ? _BV(U2X0) : 0;
+				return true;
+			}
+		}
+		return false;
 	}
 
-	//! \brief Sets the baudrate to 600
-	inline void setBaud1200 () __attribute__ ((always_inline))
+
+	//! \brief Sets the baudrate
+	//! \details Sets the rate given by the \c BAUD macro, or 9600 if
+	//! \c BAUD has not been defined.
+	inline void setBaud () __attribute__ ((always_inline))
 	{
-		#undef BAUD
-		#define BAUD 1200
-		#include <util/setbaud.h>
-		*psfr16_t (TUART::ubrrx) = UBRR_VALUE;
-		#if USE_2X
-		*psfr8_t(TUART::crsax) |= _BV(U2X0);
+		#ifdef BAUD
+		setBaud<F_CPU, BAUD>();
 		#else
-		*psfr8_t(TUART::crsax) &= ~_BV(U2X0);
+		setBaud<F_CPU, 9600>();
 		#endif
 	}
 
+
+	//! \brief Sets the baudrate to 300
+	inline void setBaud300 () __attribute__ ((always_inline)) { setBaud<F_CPU, 300>(); }
+
 	//! \brief Sets the baudrate to 1200
-	inline void setBaud2400 () __attribute__ ((always_inline))
-	{
-		#undef BAUD
-		#define BAUD 2400
-		#include <util/setbaud.h>
-		*psfr16_t (TUART::ubrrx) = UBRR_VALUE;
-		#if USE_2X
-		*psfr8_t(TUART::crsax) |= _BV(U2X0);
-		#else
-		*psfr8_t(TUART::crsax) &= ~_BV(U2X0);
-		#endif
-	}
+	inline void setBaud1200 () __attribute__ ((always_inline)) { setBaud<F_CPU, 1200>(); }
+
+	//! \brief Sets the baudrate to 2400
+	inline void setBaud2400 () __attribute__ ((always_inline)) { setBaud<F_CPU, 2400>(); }
 
 	//! \brief Sets the baudrate to 4800
-	inline void setBaud4800 () __attribute__ ((always_inline))
-	{
-		#undef BAUD
-		#define BAUD 4800
-		#include <util/setbaud.h>
-		*psfr16_t (TUART::ubrrx) = UBRR_VALUE;
-		#if USE_2X
-		*psfr8_t(TUART::crsax) |= _BV(U2X0);
-		#else
-		*psfr8_t(TUART::crsax) &= ~_BV(U2X0);
-		#endif
-	}
+	inline void setBaud4800 () __attribute__ ((always_inline)) { setBaud<F_CPU, 4800>(); }
 
 	//! \brief Sets the baudrate to 9600
-	inline void setBaud9600 () __attribute__ ((always_inline))
-	{
-		#undef BAUD
-		#define BAUD 9600
-		#include <util/setbaud.h>
-		*psfr16_t (TUART::ubrrx) = UBRR_VALUE;
-		#if USE_2X
-		*psfr8_t(TUART::crsax) |= _BV(U2X0);
-		#else
-		*psfr8_t(TUART::crsax) &= ~_BV(U2X0);
-		#endif
-	}
+	inline void setBaud9600 () __attribute__ ((always_inline)) { setBaud<F_CPU, 9600>(); }
 
 	//! \brief Sets the baudrate to 19200
-	inline void setBaud19200 () __attribute__ ((always_inline))
-	{
-		#undef BAUD
-		#define BAUD 19200
-		#include <util/setbaud.h>
-		*psfr16_t (TUART::ubrrx) = UBRR_VALUE;
-		#if USE_2X
-		*psfr8_t(TUART::crsax) |= _BV(U2X0);
-		#else
-		*psfr8_t(TUART::crsax) &= ~_BV(U2X0);
-		#endif
-	}
+	inline void setBaud19200 () __attribute__ ((always_inline)) { setBaud<F_CPU, 19200>(); }
 
 	//! \brief Sets the baudrate to 38400
-	inline void setBaud38400 () __attribute__ ((always_inline))
-	{
-		#undef BAUD
-		#define BAUD 38400
-		#include <util/setbaud.h>
-		*psfr16_t (TUART::ubrrx) = UBRR_VALUE;
-		#if USE_2X
-		*psfr8_t(TUART::crsax) |= _BV(U2X0);
-		#else
-		*psfr8_t(TUART::crsax) &= ~_BV(U2X0);
-		#endif
-	}
+	inline void setBaud38400 () __attribute__ ((always_inline)) { setBaud<F_CPU, 38400>(); }
 
 	//! \brief Sets the baudrate to 57600
-	inline void setBaud57600 () __attribute__ ((always_inline))
-	{
-		#undef BAUD
-		#define BAUD 57600
-		#include <util/setbaud.h>
-		*psfr16_t (TUART::ubrrx) = UBRR_VALUE;
-		#if USE_2X
-		*psfr8_t(TUART::crsax) |= _BV(U2X0);
-		#else
-		*psfr8_t(TUART::crsax) &= ~_BV(U2X0);
-		#endif
-	}
+	inline void setBaud57600 () __attribute__ ((always_inline)) { setBaud<F_CPU, 57600>(); }
 
 	//! \brief Sets the baudrate to 115200
-	inline void setBaud115200 () __attribute__ ((always_inline))
-	{
-		#undef BAUD
-		#define BAUD 115200
-		#include <util/setbaud.h>
-		*psfr16_t (TUART::ubrrx) = UBRR_VALUE;
-		#if USE_2X
-		*psfr8_t(TUART::crsax) |= _BV(U2X0);
-		#else
-		*psfr8_t(TUART::crsax) &= ~_BV(U2X0);
-		#endif
-	}
+	inline void setBaud115200 () __attribute__ ((always_inline)) { setBaud<F_CPU, 115200>(); }
 
 	//== DATABIT ==
 	//! \brief Sets 8 data bits
@@ -423,166 +1575,237 @@ public:
 	//! fdev_setup_stream(&mystdout, uart0_putchar, uart0_getchar, _FDEV_SETUP_RW);
 	//! stdout=&mystdout;
 	//! \endcode
+	//! Any translation is done by the discipline in TOPTIONS.
 	//! \return The character written if successful
 	inline
 	int putch(char c, FILE *stream) __attribute__((always_inline))
 	{
-		if (c == '\a')
+		return line.putch (*this, c, stream);
+	}
+
+	//! \brief STDIO support for reading a character
+	//! \details Handled by the discipline in TOPTIONS: UartRaw returns
+	//! whatever has been received, UartCooked a line at a time once it has
+	//! been edited and UartBinary waits for each byte.
+	//! \return The character read, or _FDEV_EOF or _FDEV_ERR
+	int getch(FILE *stream)
+	{
+		return line.getch (*this, stream);
+	}
+
+
+protected:
+private:
+	// writes the data register, clearing the transmit complete flag first
+	// so flush() can tell when this byte has gone
+	inline void writeData (uint8_t data, bool bit9 = false) __attribute__((always_inline))
+	{
+		// TXB8 has to be written before UDR
+		if (TOPTIONS::multiprocessor)
 		{
-			fputs("*ring*\n", stderr);
-			return 0;
+			if (bit9)
+				_sbi (*psfr8_t (TUART::crsbx), TXB80);
+			else
+				_cbi (*psfr8_t (TUART::crsbx), TXB80);
 		}
-		
-		if (c== '\n')
-			putch('\r', stream);
-		
-		write(c);
-		return c;
+
+		*psfr8_t (TUART::crsax) = (*psfr8_t (TUART::crsax) & (_BV(U2X0) | _BV(MPCM0))) | _BV(TXC0);
+
+		// with TXC cleared a pending txCompleteIsr() can no longer release
+		// the bus after the driver has been enabled
+		dePin.set();
+		*psfr8_t (TUART::datax) = data;
+		txWritten = true;
+		stats.sent();
+		txCrc.update (data);
 	}
 
-	//! \brief Receive a character from the UART Rx.
-	//! \details This features a simple line-editor that allows to delete and
-	//! re-edit the characters entered, until either CR or NL is entered.
-	//! Printable characters entered will be echoed using uart_putchar().
-	//!
-	//! Editing characters:
-	//!
-	//! . \b (BS) or \177 (DEL) delete the previous character
-	//! . ^u kills the entire input buffer
-	//! . ^w deletes the previous word
-	//! . ^r sends a CR, and then reprints the buffer
-	//! . \t will be replaced by a single space
-	//!
-	//! All other control characters will be ignored.
-	//!
-	//! The internal line buffer is RX_BUFSIZE (80) characters long, which
-	//! includes the terminating \n (but no terminating \0).  If the buffer
-	//! is full (i. e., at RX_BUFSIZE-1 characters in order to keep space for
-	//! the trailing \n), any further input attempts will send a \a to
-	//! uart_putchar() (BEL character), although line editing is still
-	//! allowed.
-	//!
-	//! Input errors while talking to the UART will cause an immediate
-	//! return of -1 (error indication).  Notably, this will be caused by a
-	//! framing error (e. g. serial line "break" condition), by an input
-	//! overrun, and by a parity error (if parity was enabled and automatic
-	//! parity recognition is supported by hardware).
-	//!
-	//! Successive calls to uart_getchar() will be satisfied from the
-	//! internal buffer until that buffer is emptied again.
-	int getch(FILE *stream)
+
+	// prints the magnitude of a number in decimal, with a sign, a decimal
+	// point before the last decimals digits and padding on the left
+	template <typename T>
+	void printNumber (T value, bool negative, uint8_t width, char pad, uint8_t decimals)
 	{
-		#if 1
-		
-		if (!rxReady())
-			return _FDEV_EOF;
-			
-		uint8_t ch = read();
-		return ch;
-		
-		#else
-		uint8_t c;
-		char *cp, *cp2;
-		static char *rxp;
+		char buf [10];
+		uint8_t n = uartDecDigits (buf, value, decimals + 1);
+		uint8_t len = n + negative + (decimals ? 1 : 0);
+
+		// the sign goes before zeros but after spaces
+		if (negative && pad == '0')
+			write ('-');
+		for (; width > len; width--)
+			write (pad);
+		if (negative && pad != '0')
+			write ('-');
+
+		for (uint8_t i = 0; i < n; i++)
+		{
+			if (decimals && i == n - decimals)
+				write ('.');
+			write (buf[i]);
+		}
+	}
 
-		if (rxp == 0)
-			for (cp = rxbuf;;)
-			{
-				//loop_until_bit_is_set(UCSR0A, RXC0);
-				while (!rxReady())
-					;
-
-				//if (UCSR0A & _BV(FE0))
-				if (isOverrun())
-					return _FDEV_EOF;
-				//if (UCSR0A & _BV(DOR0))
-				if (isFrameError())
-					return _FDEV_ERR;
-			
-				//c = *psfr8_t (TUART::datax);	//UDR0;
-				c = read();
-			
-				/* behaviour similar to Unix stty ICRNL */
-				if (c == '\r')
-					c = '\n';
-				if (c == '\n')
-				{
-					*cp = c;
-					putch(c, stream);
-					rxp = rxbuf;
-					break;
-				}
-				else if (c == '\t')
-					c = ' ';
 
-				if ((c >= (uint8_t)' ' && c <= (uint8_t)'\x7e') || c >= (uint8_t)'\xa0')
-				{
-					if (cp == rxbuf + MAX_UARTBUF - 1)
-						putch('\a', stream);
-					else
-					{
-						*cp++ = c;
-						putch(c, stream);
-					}
-					continue;
-				}
+	// prints a number in hexadecimal padded on the left to width digits
+	template <typename T>
+	void printHex (T value, uint8_t width, char pad)
+	{
+		uint8_t digits = sizeof(T) * 2;
+		while (digits > 1 && !(value >> (4 * (digits - 1))))
+			digits--;
 
-				switch (c)
-				{
-					case 'c' & 0x1f:
-						return -1;
+		for (; width > digits; width--)
+			write (pad);
 
-					case '\b':
-					case '\x7f':
-						if (cp > rxbuf)
-						{
-							putch('\b', stream);
-							putch(' ', stream);
-							putch('\b', stream);
-							cp--;
-						}
-						break;
+		while (digits--)
+		{
+			uint8_t nibble = (value >> (4 * digits)) & 0x0f;
+			write (nibble < 10 ? '0' + nibble : 'A' - 10 + nibble);
+		}
+	}
 
-					case 'r' & 0x1f:
-						putch('\r', stream);
-						for (cp2 = rxbuf; cp2 < cp; cp2++)
-							putch(*cp2, stream);
-						break;
 
-					case 'u' & 0x1f:
-						while (cp > rxbuf)
-						{
-							putch('\b', stream);
-							putch(' ', stream);
-							putch('\b', stream);
-							cp--;
-						}
-						break;
+	// places a byte in the transmit queue applying the txFull option
+	inline void queueData (uint8_t data) __attribute__((always_inline))
+	{
+		if (txQueue.isFull())
+			stats.txStall();
 
-					case 'w' & 0x1f:
-						while (cp > rxbuf && cp[-1] != ' ')
-						{
-							putch('\b', stream);
-							putch(' ', stream);
-							putch('\b', stream);
-							cp--;
-						}
-						break;
-				}
+		if (TOPTIONS::txFull == txFullBlock)
+		{
+			while (!txQueue.put(data))
+			{
+				enableTxEmptyInt();
+				serviceTx();
+				idle<false>();
+			}
+		}
+		else if (TOPTIONS::txFull == txFullDrop)
+		{
+			txQueue.put(data);
+		}
+		else
+		{
+			// the tail belongs to the interrupt so it can only be moved
+			// with interrupts disabled
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+			{
+				if (txQueue.isFull())
+					txQueue.get();
+				txQueue.put(data);
 			}
+		}
+		stats.txLevel (txQueue.count());
+	}
 
-		c = *rxp++;
-		if (c == '\n')
-			rxp = 0;
 
-		return c;
-		#endif
+	// reads the data register along with its frame, overrun and parity
+	// error flags, which are only read if the options need them; in
+	// multiprocessor mode address frames are handled here, arming or
+	// disarming MPCM, and false is returned
+	inline bool receiveData (uint8_t & data, uint8_t & status) __attribute__((always_inline))
+	{
+		// the status and RXB8 belong to the byte in UDR so must be read first
+		status = 0;
+		if (TOPTIONS::rxErrors || TOPTIONS::stats::enabled)
+			status = *psfr8_t (TUART::crsax) & (_BV(FE0) | _BV(DOR0) | _BV(UPE0));
+
+		if (TOPTIONS::multiprocessor)
+		{
+			bool address = bit_is_set (*psfr8_t (TUART::crsbx), RXB80);
+			data = *psfr8_t (TUART::datax);
+			if (address)
+			{
+				setMpcm (data != nodeAddress);
+				return false;
+			}
+		}
+		else
+			data = *psfr8_t (TUART::datax);
+
+		stats.received (status);
+		rxCrc.update (data);
+		return true;
+	}
+
+
+	// asserts RTS once the receive queue has drained to the low watermark;
+	// the interrupt can add at most one byte between the test and the write,
+	// which is why rtsHigh must be at least two above rtsLow
+	inline void releaseRts () __attribute__((always_inline))
+	{
+		if (hasRts && rxQueue.count() <= rtsLow)
+			rtsPin.clear();
+	}
+
+
+	// called when bytes have been taken from the receive queue; releases RTS
+	// and, with the rxPending option, clears this port's bit in uartRxPending
+	// once the queue is empty; other UARTs' interrupts also write it
+	inline void dequeued () __attribute__((always_inline))
+	{
+		if (!RXSIZE)
+			return;
+
+		releaseRts();
+		if (!TOPTIONS::rxPending)
+			return;
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			if (rxQueue.isEmpty())
+				uartRxPending &= ~_BV(TUART::index);
+		}
+	}
+
+
+	// true if the receiver at the other end is ready; CTS is active low
+	inline bool isCtsActive () __attribute__((always_inline))
+	{
+		return !ctsPin.read();
+	}
+
+
+	// sets or clears MPCM without writing a one to the TXC flag
+	inline void setMpcm (bool on) __attribute__((always_inline))
+	{
+		*psfr8_t (TUART::crsax) = (*psfr8_t (TUART::crsax) & _BV(U2X0)) | (on ? _BV(MPCM0) : 0);
+	}
+
+
+	// with the sleepWait option sleeps until the next interrupt if the receive
+	// queue is still empty (RX) or the transmit queue still full.  The test
+	// is made with interrupts disabled, and as the instruction after sei is
+	// always run before any interrupt the CPU is asleep before the interrupt
+	// that ends the wait can be taken, so it cannot be missed.  Never sleeps
+	// if the caller has interrupts disabled, as nothing would wake it.
+	template <bool RX>
+	__attribute__ ((always_inline)) inline void idle ()
+	{
+		if (!TOPTIONS::sleepWait || bit_is_clear (SREG, SREG_I))
+			return;
+
+		cli();
+		if (RX ? rxQueue.isEmpty() : txQueue.isFull())
+		{
+			set_sleep_mode (SLEEP_MODE_IDLE);
+			sleep_enable();
+			sei();
+			sleep_cpu();
+			sleep_disable();
+		}
+		sei();
 	}
-	
 
-protected:
-private:
 
+	// when waiting on the transmit queue with interrupts disabled, e.g. from
+	// within another interrupt routine, drain the queue by polling
+	inline void serviceTx () __attribute__((always_inline))
+	{
+		if (bit_is_clear (SREG, SREG_I) && txReady())
+			dataEmptyIsr();
+	}
 };
 
 
@@ -596,7 +1819,7 @@ private:
 #if 1
 #ifdef UDR0
 
-Uart<UART0> uart0;
+Uart<UART0, UART0_RXSIZE, UART0_TXSIZE> uart0;
 
 inline int uart0_putchar (char c, FILE * stream)
 {
@@ -614,7 +1837,7 @@ inline int uart0_getchar (FILE * stream)
 
 #ifdef UDR1
 
-Uart<UART1> uart1;
+Uart<UART1, UART1_RXSIZE, UART1_TXSIZE> uart1;
 
 inline int uart1_putchar (char c, FILE * stream)
 {
@@ -632,7 +1855,7 @@ inline int uart1_getchar (FILE * stream)
 
 #ifdef UDR2
 
-Uart<UART2> uart2;
+Uart<UART2, UART2_RXSIZE, UART2_TXSIZE> uart2;
 
 inline int uart2_putchar (char c, FILE * stream)
 {
@@ -650,7 +1873,7 @@ inline int uart2_getchar (FILE * stream)
 
 #ifdef UDR3
 
-Uart<UART3> uart3;
+Uart<UART3, UART3_RXSIZE, UART3_TXSIZE> uart3;
 
 inline int uart3_putchar (char c, FILE * stream)
 {
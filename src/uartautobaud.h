@@ -0,0 +1,270 @@
+//***************************************************************************
+//
+//  File Name :		uartautobaud.h
+//
+//  Project :		Library for the Atmel 8 bit AVR MCU
+//
+//  Purpose :		Automatic baudrate detection for the UART
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013-2016 Andy Burgess
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//  Revisions :
+//
+//      see rcs below
+//
+//***************************************************************************
+
+
+#ifndef UARTAUTOBAUD_H_
+#define UARTAUTOBAUD_H_
+
+#include <uart.h>
+#include <timer16.h>
+// the timer headers leave the SFR macros as plain addresses
+#include <avr/io.h>
+#include "FastIO.h"
+
+
+//! \brief Measures the baudrate of a sync character and sets the UART to it
+//! \details The sync character must have 01 as its two least significant
+//! bits, such as CR or 'U'.  As the start bit is low and the bits are sent
+//! least significant first, the line then falls at the start bit and again
+//! two bit times later.  The time between the falling edges gives the bit time
+//! without depending on the rise and fall times of the line drivers, and the
+//! baudrate register is worked out from it with shifts alone:
+//! \li below 2048 cycles per bit the clock doubler is used and
+//! UBRR = bit / 8 - 1
+//! \li otherwise UBRR = bit / 16 - 1
+//!
+//! The receiver is disabled while the sync character is on the line and is
+//! enabled again half way through its stop bit, so the character after it is
+//! the first to be received, at the new rate.  Detection is therefore over
+//! within one character time.
+//!
+//! The timer is run from the CPU clock in normal mode and its registers are
+//! restored afterwards.  The slowest rate that can be measured is
+//! F_CPU / 30720, 521 baud at 16MHz; the fastest is F_CPU / 16.
+//! \code
+//! UartAutoBaud<UART0, TIMER1> autoBaud;
+//! while (!autoBaud.detect())		// RXD0 also wired to ICP1
+//! 	;
+//! \endcode
+//! \tparam TUART One of the predefined objects UART_0, UART_1, UART_2 or UART_3
+//! \tparam TTIMER16 One of the predefined objects TIMER1, TIMER3, TIMER4 or TIMER5
+template <class TUART, class TTIMER16>
+class UartAutoBaud
+{
+private:
+	static const uint16_t maxSpan = 0xf000;		// keeps clear of the timer wrapping
+
+	Timer16<TTIMER16> timer;
+	uint16_t span;								// two bit times in CPU cycles
+
+public:
+	//! \brief Initialises a new instance of the UartAutoBaud class
+	inline UartAutoBaud () __attribute__((always_inline)) : span(0) { }
+
+
+	//! \brief Detects the baudrate using the timer's input capture unit
+	//! \details The UART's RXD pin must also be connected to the ICPn pin of
+	//! the timer.  Both edges are latched by the hardware so interrupts may
+	//! stay enabled.
+	//! \param timeout The number of timer overflows (4.1ms at 16MHz) to wait
+	//! for the sync character, or zero to wait for ever
+	//! \returns True if the baudrate was set; false on a timeout or if the
+	//! measured time was out of range, in which case the baudrate is unchanged
+	bool detect (uint8_t timeout = 0)
+	{
+		bool found = false;
+		uint8_t tccra = *psfr8_t (TTIMER16::tccraRegx);
+		uint8_t tccrb = *psfr8_t (TTIMER16::tccrbRegx);
+
+		begin ();
+		timer.setCaptureMode (Fall);
+		timer.clearInputCapture ();
+
+		if (waitCapture (timeout))
+		{
+			uint16_t first = timer.readInputCapture ();
+			timer.clearInputCapture ();
+
+			while (!timer.isInputCapture ())
+				if (uint16_t (timer.read () - first) > maxSpan)
+					break;
+
+			if (timer.isInputCapture ())
+			{
+				span = timer.readInputCapture () - first;
+				found = apply (first);
+			}
+		}
+
+		end (tccra, tccrb);
+		return found;
+	}
+
+
+	//! \brief Detects the baudrate by polling the receive pin
+	//! \details For use where RXD is not connected to an input capture pin.
+	//! The pin is read in a tight loop against the free running timer, so
+	//! interrupts are disabled until the sync character has been timed or the
+	//! timeout expires.  Each edge should be seen within about 5 cycles, an
+	//! estimate from the loop that has not been measured, which limits the
+	//! accuracy at the highest rates.
+	//! \tparam RXPIN The FASTIOPIN of the UART's RXD pin
+	//! \param timeout The number of timer overflows (4.1ms at 16MHz) to wait
+	//! for the sync character, or zero to wait for ever
+	//! \returns True if the baudrate was set; false on a timeout or if the
+	//! measured time was out of range, in which case the baudrate is unchanged
+	template <uint8_t RXPIN>
+	bool detectPin (uint8_t timeout = 0)
+	{
+		FastIOPin<RXPIN> rx;
+		bool found = false;
+		uint8_t tccra = *psfr8_t (TTIMER16::tccraRegx);
+		uint8_t tccrb = *psfr8_t (TTIMER16::tccrbRegx);
+
+		begin ();
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			// the line must be idle before the start bit can be found
+			if (waitLevel (rx, true, timeout) && waitLevel (rx, false, timeout))
+			{
+				uint16_t first = timer.read ();
+				bool inRange = true;
+
+				// bit 0 is high and bit 1 low
+				while (inRange && !rx.read ())
+					inRange = uint16_t (timer.read () - first) <= maxSpan;
+				while (inRange && rx.read ())
+					inRange = uint16_t (timer.read () - first) <= maxSpan;
+
+				if (inRange)
+				{
+					span = timer.read () - first;
+					found = apply (first);
+				}
+			}
+		}
+
+		end (tccra, tccrb);
+		return found;
+	}
+
+
+	//! \brief Gets the length of the last measured bit in CPU cycles
+	inline uint16_t bitCycles () __attribute__((always_inline))
+	{
+		return span / 2;
+	}
+
+
+private:
+	// stops the receiver and starts the timer from the CPU clock
+	inline void begin () __attribute__((always_inline))
+	{
+		_cbi (*psfr8_t (TUART::crsbx), RXEN0);
+		timer.setWavegenMode (Wgen16Normal);
+		timer.setClockMode (ClkPre1);
+	}
+
+
+	// restores the timer and restarts the receiver
+	inline void end (uint8_t tccra, uint8_t tccrb) __attribute__((always_inline))
+	{
+		*psfr8_t (TTIMER16::tccrbRegx) = tccrb;
+		*psfr8_t (TTIMER16::tccraRegx) = tccra;
+		_sbi (*psfr8_t (TUART::crsbx), RXEN0);
+	}
+
+
+	// sets the baudrate from the measured span, then waits for the middle
+	// of the sync character's stop bit, 19 half bits after its start
+	bool apply (uint16_t first)
+	{
+		if (span < 32)
+			return false;
+
+		if (span < 4096)
+		{
+			*psfr16_t (TUART::ubrrx) = ((span + 8) >> 4) - 1;
+			*psfr8_t (TUART::crsax) = _BV(U2X0);
+		}
+		else
+		{
+			*psfr16_t (TUART::ubrrx) = ((span + 16) >> 5) - 1;
+			*psfr8_t (TUART::crsax) = 0;
+		}
+
+		// half a bit is less than 32768 cycles, so each step can be
+		// compared without the timer wrapping
+		uint16_t half = span / 4;
+		uint16_t mark = first;
+		for (uint8_t i = 0; i < 19; i++)
+		{
+			mark += half;
+			while (int16_t (timer.read () - mark) < 0)
+				;
+		}
+		return true;
+	}
+
+
+	// waits for the input capture flag, counting timer overflows
+	bool waitCapture (uint8_t timeout)
+	{
+		timer.clearOverflow ();
+		while (!timer.isInputCapture ())
+		{
+			if (timeout && timer.getOverFlow ())
+			{
+				timer.clearOverflow ();
+				if (--timeout == 0)
+					return false;
+			}
+		}
+		return true;
+	}
+
+
+	// waits for the pin to reach the level, counting timer overflows
+	template <class TPIN>
+	bool waitLevel (TPIN & pin, bool level, uint8_t & timeout)
+	{
+		timer.clearOverflow ();
+		while (pin.read () != level)
+		{
+			if (timeout && timer.getOverFlow ())
+			{
+				timer.clearOverflow ();
+				if (--timeout == 0)
+					return false;
+			}
+		}
+		return true;
+	}
+};
+
+
+#endif /* UARTAUTOBAUD_H_ */
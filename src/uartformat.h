@@ -0,0 +1,216 @@
+//***************************************************************************
+//
+//  File Name :		uartformat.h
+//
+//  Project :		Library for the Atmel 8 bit AVR MCU
+//
+//  Purpose :		Type safe number formatting for the UART print methods
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013-2016 Andy Burgess
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//  Revisions :
+//
+//      see rcs below
+//
+//***************************************************************************
+
+
+#ifndef UARTFORMAT_H_
+#define UARTFORMAT_H_
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+
+//! \file
+//! \brief The format of each argument passed to Uart::print() is chosen by its
+//! type, so there is no format string to parse at run time.  Plain integers
+//! print in decimal, and the dec(), hex() and fixed() helpers wrap a value
+//! with a width and pad character fixed at compile time:
+//! \code
+//! uart0.println(F("T="), fixed<2>(temp), F(" P="), hex<4>(p), ' ', dec<5>(count));
+//! \endcode
+
+
+//! \brief An incomplete type used to mark a string held in program memory
+class FlashString;
+
+#ifndef F
+//! \def F(str)
+//! \brief Places a string literal in program memory and marks it for
+//! the Uart print methods
+#define F(str) (reinterpret_cast<const FlashString *>(PSTR(str)))
+#endif
+
+
+//! \brief Chooses between two types at compile time
+template <bool COND, typename TTRUE, typename TFALSE>
+struct UartSelect { typedef TTRUE type; };
+
+template <typename TTRUE, typename TFALSE>
+struct UartSelect<false, TTRUE, TFALSE> { typedef TFALSE type; };
+
+
+//! \brief Properties of an integer type used by the formatter
+//! \details Eight and sixteen bit values are formatted with sixteen bit
+//! arithmetic; only thirty two bit values pay for thirty two bit arithmetic.
+template <typename T>
+struct UartInt
+{
+	static_assert(sizeof(T) <= 4, "Only integers up to 32 bits can be printed");
+
+	//! \brief True if the type is signed
+	static const bool isSigned = T(-1) < T(0);
+
+	//! \brief The unsigned type that holds the magnitude of a value
+	typedef typename UartSelect<(sizeof(T) > 2), uint32_t, uint16_t>::type utype;
+
+	//! \brief True if the value is negative
+	static inline bool negative (T value) __attribute__((always_inline))
+	{
+		return isSigned && value < T(0);
+	}
+
+	//! \brief Returns the magnitude of the value
+	static inline utype magnitude (T value) __attribute__((always_inline))
+	{
+		return negative(value) ? utype(0) - utype(value) : utype(value);
+	}
+};
+
+
+//! \brief A value to be printed in decimal
+template <typename T, uint8_t WIDTH, char PAD>
+struct UartDec { T value; };
+
+//! \brief A value to be printed in hexadecimal
+template <typename T, uint8_t WIDTH, char PAD>
+struct UartHex { T value; };
+
+//! \brief An integer holding a value scaled by 10^DECIMALS, to be printed
+//! with a decimal point
+template <typename T, uint8_t DECIMALS, uint8_t WIDTH, char PAD>
+struct UartFixed { T value; };
+
+
+//! \brief Prints a value in decimal
+//! \tparam WIDTH The minimum number of characters, including any sign
+//! \tparam PAD The character used to pad to the width, ' ' or '0'
+//! \param value The integer to print
+template <uint8_t WIDTH = 0, char PAD = ' ', typename T>
+inline UartDec<T, WIDTH, PAD> dec (T value)
+{
+	UartDec<T, WIDTH, PAD> f = { value };
+	return f;
+}
+
+
+//! \brief Prints a value in upper case hexadecimal
+//! \tparam WIDTH The minimum number of digits
+//! \tparam PAD The character used to pad to the width
+//! \param value The integer to print
+//! \note Negative values are printed as their two's complement
+template <uint8_t WIDTH = 0, char PAD = '0', typename T>
+inline UartHex<T, WIDTH, PAD> hex (T value)
+{
+	UartHex<T, WIDTH, PAD> f = { value };
+	return f;
+}
+
+
+//! \brief Prints a fixed point value
+//! \details The integer is printed with a decimal point inserted DECIMALS
+//! digits from the right, so fixed<2>(-1234) prints -12.34 and fixed<2>(5)
+//! prints 0.05.
+//! \tparam DECIMALS The number of digits after the decimal point
+//! \tparam WIDTH The minimum number of characters, including the sign and point
+//! \tparam PAD The character used to pad to the width, ' ' or '0'
+//! \param value The scaled integer to print
+template <uint8_t DECIMALS, uint8_t WIDTH = 0, char PAD = ' ', typename T>
+inline UartFixed<T, DECIMALS, WIDTH, PAD> fixed (T value)
+{
+	UartFixed<T, DECIMALS, WIDTH, PAD> f = { value };
+	return f;
+}
+
+
+//! \brief Powers of ten used to convert to decimal by repeated subtraction
+template <typename T>
+struct UartPow10;
+
+template <>
+struct UartPow10<uint16_t>
+{
+	static const uint8_t count = 4;
+	static inline uint16_t read (uint8_t i) __attribute__((always_inline))
+	{
+		static const uint16_t table [count] PROGMEM = { 10000, 1000, 100, 10 };
+		return pgm_read_word (&table[i]);
+	}
+};
+
+template <>
+struct UartPow10<uint32_t>
+{
+	static const uint8_t count = 9;
+	static inline uint32_t read (uint8_t i) __attribute__((always_inline))
+	{
+		static const uint32_t table [count] PROGMEM =
+			{ 1000000000, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10 };
+		return pgm_read_dword (&table[i]);
+	}
+};
+
+
+//! \brief Converts an unsigned value to decimal digits
+//! \details Uses repeated subtraction of powers of ten so no division
+//! is needed.  Leading zeros are suppressed down to minDigits digits.
+//! \param buf Receives the digits, most significant first.  Must have room
+//! for five digits for a sixteen bit value or ten for a thirty two bit value.
+//! \param value The value to convert
+//! \param minDigits The minimum number of digits to produce
+//! \returns The number of digits written to buf
+template <typename T>
+uint8_t uartDecDigits (char * buf, T value, uint8_t minDigits)
+{
+	typedef UartPow10<T> pow;
+	uint8_t n = 0;
+
+	for (uint8_t i = 0; i < pow::count; i++)
+	{
+		T p = pow::read(i);
+		char d = '0';
+		while (value >= p)
+		{
+			value -= p;
+			d++;
+		}
+		if (n || d != '0' || pow::count - i < minDigits)
+			buf[n++] = d;
+	}
+	buf[n++] = '0' + value;
+	return n;
+}
+
+
+#endif /* UARTFORMAT_H_ */
@@ -0,0 +1,236 @@
+//***************************************************************************
+//
+//  File Name :		uartlog.h
+//
+//  Project :		Library for the Atmel 8 bit AVR MCU
+//
+//  Purpose :		Deferred binary logging drained through the UART
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013-2016 Andy Burgess
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//  Revisions :
+//
+//      see rcs below
+//
+//***************************************************************************
+
+
+#ifndef UARTLOG_H_
+#define UARTLOG_H_
+
+#include <stdint.h>
+#include <util/atomic.h>
+#include <ringbuffer.h>
+
+
+//! \brief Works out the identity of a log message from its format string
+//! \details The 32 bit FNV-1a hash of the string, folded to 16 bits.  It is
+//! only ever evaluated by the compiler, so the string is not stored.
+constexpr uint16_t uartLogHash (const char * format, uint32_t hash = 2166136261UL)
+{
+	return *format ?
+		uartLogHash (format + 1, (hash ^ uint8_t (*format)) * 16777619UL) :
+		uint16_t (hash ^ (hash >> 16));
+}
+
+
+// forces the hash to be worked out at compile time
+template <uint16_t ID>
+struct UartLogId { static const uint16_t value = ID; };
+
+
+// the types that may be logged
+template <typename T> struct UartLogIsNumber { static const bool value = false; };
+template <> struct UartLogIsNumber<bool> { static const bool value = true; };
+template <> struct UartLogIsNumber<char> { static const bool value = true; };
+template <> struct UartLogIsNumber<signed char> { static const bool value = true; };
+template <> struct UartLogIsNumber<unsigned char> { static const bool value = true; };
+template <> struct UartLogIsNumber<short> { static const bool value = true; };
+template <> struct UartLogIsNumber<unsigned short> { static const bool value = true; };
+template <> struct UartLogIsNumber<int> { static const bool value = true; };
+template <> struct UartLogIsNumber<unsigned int> { static const bool value = true; };
+template <> struct UartLogIsNumber<long> { static const bool value = true; };
+template <> struct UartLogIsNumber<unsigned long> { static const bool value = true; };
+template <> struct UartLogIsNumber<long long> { static const bool value = true; };
+template <> struct UartLogIsNumber<unsigned long long> { static const bool value = true; };
+template <> struct UartLogIsNumber<float> { static const bool value = true; };
+template <> struct UartLogIsNumber<double> { static const bool value = true; };
+
+
+// an argument as it is stored: promoted as it would be for printf, so a
+// char or uint8_t takes the two bytes of an int
+template <typename T>
+struct UartLogArg
+{
+	static_assert(UartLogIsNumber<T>::value, "Only numbers may be logged");
+	typedef decltype (+T()) type;
+};
+
+
+// the number of bytes taken by the arguments
+template <typename... TARGS>
+struct UartLogSize { static const uint8_t value = 0; };
+
+template <typename T, typename... TREST>
+struct UartLogSize<T, TREST...>
+{
+	static const uint8_t value = sizeof (typename UartLogArg<T>::type) + UartLogSize<TREST...>::value;
+};
+
+
+//! \brief Logs a message to a UartLog
+//! \details The format string is reduced to its identity by the compiler
+//! and the arguments are stored as they are; nothing is formatted.
+//! \code
+//! UART_LOG (log, "adc %u of %u, t=%ld", channel, reading, millis);
+//! \endcode
+#define UART_LOG(log, format, ...) \
+	(log).put (UartLogId<uartLogHash (format)>::value, ##__VA_ARGS__)
+
+
+//! \brief A log of binary records drained through a UART in the background
+//! \details Logging a message stores only the identity of its format
+//! string and the bytes of its arguments, in an estimated few tens of
+//! cycles (not measured), so it can be done from an interrupt.  drain() moves the records on to the
+//! port as its transmit queue has room, and the host formats them.  No
+//! format strings are held in flash.
+//!
+//! Each record is sent as a length byte giving the number of bytes that
+//! follow, the 16 bit identity low byte first, then the arguments in order,
+//! each promoted as printf's arguments are and in its native little endian
+//! form.  The host decoder, tools/uartlog.py, builds its table of
+//! identities by applying uartLogHash() to the format strings of the
+//! UART_LOG() calls in the source, and reads the argument sizes from the
+//! conversions: %c, %d, %u and %x 2 bytes, %ld, %lu, %lx and %f 4 bytes.
+//! Only numbers may be logged.  Two formats with the same identity are
+//! reported by the decoder and one must be reworded.
+//!
+//! A record that does not fit is dropped and counted; when there is room
+//! again a record with identity zero and a one byte count of the dropped
+//! records is logged first.
+//! \code
+//! UartLog<64> log;
+//! Uart<UART0, 0, 32> debug;
+//! ISR(USART0_UDRE_vect) { debug.dataEmptyIsr(); }
+//!
+//! UART_LOG (log, "rx %u", length);
+//! ...
+//! log.drain (debug);		// in the main loop
+//! \endcode
+//! \tparam SIZE The size of the log in bytes, a power of two up to 128
+template <uint8_t SIZE>
+class UartLog
+{
+private:
+	RingBuffer<SIZE> queue;
+	uint8_t dropped;
+
+public:
+	//! \brief Initialises a new instance of the UartLog class
+	inline UartLog () __attribute__((always_inline)) : dropped(0) { }
+
+
+	//! \brief Adds a record to the log
+	//! \details Normally called through UART_LOG().  May be called from
+	//! interrupts as well as the main code.
+	//! \param id The identity of the message
+	//! \param args The numbers to log
+	//! \returns False if there was no room and the record was dropped
+	template <typename... TARGS>
+	bool put (uint16_t id, TARGS... args)
+	{
+		static const uint8_t length = 2 + UartLogSize<TARGS...>::value;
+		static_assert(length < SIZE, "The log record is larger than the UartLog");
+
+		bool done = false;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			if (dropped && queue.space() >= 4 + length + 1)
+			{
+				// a raw byte rather than a promoted argument, so the
+				// record stays the four bytes reserved for it
+				queue.put (3);
+				queue.put (0);
+				queue.put (0);
+				queue.put (dropped);
+				dropped = 0;
+			}
+
+			if (!dropped && queue.space() >= length + 1)
+			{
+				putRecord (id, args...);
+				done = true;
+			}
+			else if (dropped != 0xff)
+				dropped++;
+		}
+		return done;
+	}
+
+
+	//! \brief Sends as much of the log as the port can take without waiting
+	//! \details Call from the main loop.  Only one caller may drain the log.
+	//! \param port The Uart, or any object with availableForWrite() and
+	//! write(uint8_t) methods
+	template <class TPORT>
+	void drain (TPORT & port)
+	{
+		while (!queue.isEmpty() && port.availableForWrite())
+			port.write (queue.get());
+	}
+
+
+	//! \brief Indicates if there are records still to be sent
+	inline bool isEmpty () __attribute__((always_inline))
+	{
+		return queue.isEmpty();
+	}
+
+
+private:
+	template <typename... TARGS>
+	__attribute__ ((always_inline)) inline void putRecord (uint16_t id, TARGS... args)
+	{
+		queue.put (2 + UartLogSize<TARGS...>::value);
+		queue.put (uint8_t (id));
+		queue.put (uint8_t (id >> 8));
+		putArgs (args...);
+	}
+
+
+	inline void putArgs () __attribute__((always_inline)) { }
+
+
+	template <typename T, typename... TREST>
+	__attribute__ ((always_inline)) inline void putArgs (T value, TREST... rest)
+	{
+		typename UartLogArg<T>::type promoted = value;
+		const uint8_t * bytes = reinterpret_cast<const uint8_t *> (&promoted);
+		for (uint8_t i = 0; i < sizeof (promoted); i++)
+			queue.put (bytes[i]);
+		putArgs (rest...);
+	}
+};
+
+
+#endif /* UARTLOG_H_ */
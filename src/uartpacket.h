@@ -0,0 +1,360 @@
+//***************************************************************************
+//
+//  File Name :		uartpacket.h
+//
+//  Project :		Library for the Atmel 8 bit AVR MCU
+//
+//  Purpose :		Packet framing (COBS or SLIP) on top of the UART
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013-2016 Andy Burgess
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//  Revisions :
+//
+//      see rcs below
+//
+//***************************************************************************
+
+
+#ifndef UARTPACKET_H_
+#define UARTPACKET_H_
+
+#include <uart.h>
+
+
+//! \brief An enumeration of the results of decoding one received byte
+enum uart_frame_t
+{
+	frameNone,		//!< the byte was consumed and produced no data
+	frameData,		//!< the byte produced one byte of packet data
+	frameEnd,		//!< the byte ended the packet
+	frameError,		//!< the packet is corrupt and should be discarded
+	frameAbort		//!< the byte ended the packet, which is corrupt
+};
+
+
+//! \brief Consistent Overhead Byte Stuffing
+//! \details COBS removes every zero from the packet so that a zero can mark
+//! the end of each frame.  The overhead is one byte in every 254 plus the
+//! frame delimiter.
+class CobsCodec
+{
+private:
+	uint8_t code;		// code byte of the current block, zero at frame start
+	uint8_t remain;		// data bytes left in the current block
+
+public:
+	inline CobsCodec () __attribute__((always_inline)) : code(0), remain(0) { }
+
+
+	//! \brief Decodes one received byte
+	//! \param in The received byte
+	//! \param out Receives the decoded byte when frameData is returned
+	//! \returns One of the uart_frame_t values
+	inline uart_frame_t decode (uint8_t in, uint8_t & out) __attribute__((always_inline))
+	{
+		if (in == 0)
+		{
+			// delimiter - the frame is only whole if the last block was complete;
+			// one with no code byte is empty, as when a sender resynchronises
+			uart_frame_t result = (code == 0) ? frameNone : (remain == 0) ? frameEnd : frameAbort;
+			code = 0;
+			remain = 0;
+			return result;
+		}
+
+		if (remain)
+		{
+			remain--;
+			out = in;
+			return frameData;
+		}
+
+		// a code byte; every block except a full one ends with a zero,
+		// which is only emitted when another block follows
+		uint8_t last = code;
+		code = in;
+		remain = in - 1;
+		if (last != 0 && last != 0xff)
+		{
+			out = 0;
+			return frameData;
+		}
+		return frameNone;
+	}
+
+
+	//! \brief Encodes and writes a packet, including the frame delimiter
+	//! \details The packet is encoded as it is written, so no encoded copy
+	//! is made.
+	//! \param port The object whose write methods send the bytes
+	//! \param data Pointer to the packet
+	//! \param count The number of bytes in the packet
+	template <class TPORT>
+	static void encode (TPORT & port, const uint8_t * data, uint8_t count)
+	{
+		const uint8_t * end = data + count;
+
+		for (;;)
+		{
+			uint8_t run = 0;
+			while (data + run < end && data[run] != 0 && run < 254)
+				run++;
+
+			port.write (run + 1);
+			port.write (data, run);
+			data += run;
+
+			if (data == end)
+				break;
+
+			// skip the zero, it is implied by the code byte
+			if (run < 254)
+				data++;
+		}
+		port.write (0);
+	}
+};
+
+
+//! \brief Serial Line Internet Protocol framing (RFC 1055)
+//! \details Each frame ends with 0xC0; 0xC0 and 0xDB in the packet are sent
+//! as two byte escape sequences.
+class SlipCodec
+{
+private:
+	static const uint8_t slipEnd = 0xc0;
+	static const uint8_t slipEsc = 0xdb;
+	static const uint8_t slipEscEnd = 0xdc;
+	static const uint8_t slipEscEsc = 0xdd;
+
+	bool escape;		// the previous byte was slipEsc
+
+public:
+	inline SlipCodec () __attribute__((always_inline)) : escape(false) { }
+
+
+	//! \brief Decodes one received byte
+	//! \param in The received byte
+	//! \param out Receives the decoded byte when frameData is returned
+	//! \returns One of the uart_frame_t values
+	inline uart_frame_t decode (uint8_t in, uint8_t & out) __attribute__((always_inline))
+	{
+		if (in == slipEnd)
+		{
+			uart_frame_t result = escape ? frameAbort : frameEnd;
+			escape = false;
+			return result;
+		}
+
+		if (escape)
+		{
+			escape = false;
+			if (in == slipEscEnd)
+				out = slipEnd;
+			else if (in == slipEscEsc)
+				out = slipEsc;
+			else
+				return frameError;
+			return frameData;
+		}
+
+		if (in == slipEsc)
+		{
+			escape = true;
+			return frameNone;
+		}
+
+		out = in;
+		return frameData;
+	}
+
+
+	//! \brief Encodes and writes a packet, including the frame delimiters
+	//! \details A delimiter is also sent before the packet to flush out any
+	//! line noise received by the other end.
+	//! \param port The object whose write methods send the bytes
+	//! \param data Pointer to the packet
+	//! \param count The number of bytes in the packet
+	template <class TPORT>
+	static void encode (TPORT & port, const uint8_t * data, uint8_t count)
+	{
+		port.write (slipEnd);
+		while (count--)
+		{
+			uint8_t c = *data++;
+			if (c == slipEnd)
+			{
+				port.write (slipEsc);
+				port.write (slipEscEnd);
+			}
+			else if (c == slipEsc)
+			{
+				port.write (slipEsc);
+				port.write (slipEscEsc);
+			}
+			else
+				port.write (c);
+		}
+		port.write (slipEnd);
+	}
+};
+
+
+//! \brief A UART that sends and receives framed packets
+//! \details Received bytes are decoded in the receive interrupt straight into
+//! one of two packet buffers.  When a whole packet has arrived the buffers are
+//! swapped and isPacketReady() becomes true, so the main line code does no
+//! per byte work and the interrupt can go on receiving the next packet into
+//! the other buffer.  If a packet completes while the previous one has still
+//! not been released, or is longer than MAXPACKET, it is discarded.  Empty
+//! packets are ignored.
+//! \code
+//! UartPacket<UART0, CobsCodec, 32> link;
+//! ISR(USART0_RX_vect) { link.rxCompleteIsr(); }
+//!
+//! link.init();
+//! link.setBaud<F_CPU, 115200>();
+//! if (link.isPacketReady())
+//! {
+//! 	process (link.packet(), link.packetLength());
+//! 	link.releasePacket();
+//! }
+//! link.writePacket (&telemetry, sizeof(telemetry));
+//! \endcode
+//! \tparam TUART One of the predefined objects UART_0, UART_1, UART_2 or UART_3
+//! \tparam TCODEC The framing, CobsCodec or SlipCodec
+//! \tparam MAXPACKET The size of the largest decoded packet
+//! \tparam TXSIZE Size of the transmit queue, see Uart
+//! \tparam TOPTIONS A structure derived from UartOptions
+template <class TUART, class TCODEC, uint8_t MAXPACKET, uint8_t TXSIZE = 0, class TOPTIONS = UartOptions>
+class UartPacket : public Uart<TUART, 0, TXSIZE, TOPTIONS>
+{
+private:
+	TCODEC codec;
+	uint8_t buffer [2][MAXPACKET];
+	uint8_t fill;						// buffer being filled by the interrupt
+	uint8_t count;						// bytes in the fill buffer
+	bool discard;						// drop bytes until the end of the frame
+	volatile bool ready;				// a packet is waiting in the other buffer
+	volatile uint8_t readyLength;
+
+public:
+	//! \brief Initialises a new instance of the UartPacket class
+	inline UartPacket () __attribute__((always_inline)) :
+		fill(0), count(0), discard(false), ready(false), readyLength(0) { }
+
+
+	//! \brief Initialises the UART as Uart::init() and enables the
+	//! receive interrupt
+	inline void init () __attribute__((always_inline))
+	{
+		Uart<TUART, 0, TXSIZE, TOPTIONS>::init();
+		this->enableRxInt();
+	}
+
+
+	//! \brief Indicates if a whole packet has been received
+	inline bool isPacketReady () __attribute__((always_inline))
+	{
+		return ready;
+	}
+
+
+	//! \brief Gets the received packet
+	//! \details Only valid while isPacketReady() is true.  The data stays in
+	//! place until releasePacket() is called.
+	inline const uint8_t * packet () __attribute__((always_inline))
+	{
+		return buffer[fill ^ 1];
+	}
+
+
+	//! \brief Gets the number of bytes in the received packet
+	inline uint8_t packetLength () __attribute__((always_inline))
+	{
+		return readyLength;
+	}
+
+
+	//! \brief Hands the packet buffer back to the receive interrupt
+	inline void releasePacket () __attribute__((always_inline))
+	{
+		ready = false;
+	}
+
+
+	//! \brief Encodes and sends a packet
+	//! \details The packet is encoded as it is written so no encoded copy is
+	//! needed; it may be any structure in RAM.
+	//! \param data Pointer to the packet
+	//! \param length The number of bytes in the packet
+	inline void writePacket (const void * data, uint8_t length) __attribute__((always_inline))
+	{
+		TCODEC::encode (*this, static_cast<const uint8_t *> (data), length);
+	}
+
+
+	//! \brief Receive complete interrupt handler
+	//! \details Call from the USARTn_RX_vect interrupt routine.  Replaces
+	//! Uart::rxCompleteIsr().
+	inline void rxCompleteIsr () __attribute__((always_inline))
+	{
+		uint8_t data;
+
+		switch (codec.decode (*psfr8_t (TUART::datax), data))
+		{
+			case frameData:
+				if (count < MAXPACKET)
+					buffer[fill][count++] = data;
+				else
+					discard = true;
+				break;
+
+			case frameEnd:
+				if (!discard && count && !ready)
+				{
+					readyLength = count;
+					fill ^= 1;
+					ready = true;
+				}
+				count = 0;
+				discard = false;
+				break;
+
+			case frameError:
+				discard = true;
+				break;
+
+			case frameAbort:
+				count = 0;
+				discard = false;
+				break;
+
+			case frameNone:
+				break;
+		}
+	}
+};
+
+
+#endif /* UARTPACKET_H_ */
@@ -56,11 +56,13 @@
 
 //! \brief Macro to define a structure for a particular port
 //! \param NAME The final name of the structure
+//! \param INDEX The number of the UART, its bit in uartRxPending
 //! \param PINREG The PIN SFR of this port
 //! \param DATAREG The PORT SFR of this port
 //! \param DDRREG The DDR SFR of this port
-#define _defUart(NAME, DATAREG, CSRAREG, CSRBREG, CSRCREG, UBRRREG) \
+#define _defUart(NAME, INDEX, DATAREG, CSRAREG, CSRBREG, CSRCREG, UBRRREG) \
 struct NAME { \
+	static const uint8_t index = INDEX; \
 	static const uint16_t datax = DATAREG; \
 	static const uint16_t crsax = CSRAREG; \
 	static const uint16_t crsbx = CSRBREG; \
@@ -72,19 +74,19 @@ struct NAME { \
 // Define a structure for each IO port that physically exists on a processor
 
 #ifdef UDR0
-_defUart(UART0, UDR0, UCSR0A, UCSR0B, UCSR0C, UBRR0);
+_defUart(UART0, 0, UDR0, UCSR0A, UCSR0B, UCSR0C, UBRR0);
 #endif
 
 #ifdef UDR1
-_defUart(UART1, UDR1, UCSR1A, UCSR1B, UCSR1C, UBRR1);
+_defUart(UART1, 1, UDR1, UCSR1A, UCSR1B, UCSR1C, UBRR1);
 #endif
 
 #ifdef UDR2
-_defUart(UART2, UDR2, UCSR2A, UCSR2B, UCSR2C, UBRR2);
+_defUart(UART2, 2, UDR2, UCSR2A, UCSR2B, UCSR2C, UBRR2);
 #endif
 
 #ifdef UDR3
-_defUart(UART3, UDR3, UCSR3A, UCSR3B, UCSR3C, UBRR3);
+_defUart(UART3, 3, UDR3, UCSR3A, UCSR3B, UCSR3C, UBRR3);
 #endif
 
 
@@ -0,0 +1,117 @@
+//***************************************************************************
+//
+//  File Name :		uartset.h
+//
+//  Project :		Library for the Atmel 8 bit AVR MCU
+//
+//  Purpose :		Readiness of several UARTs in one read
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013-2016 Andy Burgess
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//  Revisions :
+//
+//      see rcs below
+//
+//***************************************************************************
+
+
+#ifndef UARTSET_H_
+#define UARTSET_H_
+
+#include <uart.h>
+
+
+// builds the mask of the UARTs' bits and reads their RXC flags
+template <class... TUARTS>
+struct UartSetBits
+{
+	static const uint8_t mask = 0;
+
+	static inline uint8_t received () __attribute__((always_inline)) { return 0; }
+};
+
+template <class TUART, class... TREST>
+struct UartSetBits<TUART, TREST...>
+{
+	static const uint8_t mask = _BV(TUART::index) | UartSetBits<TREST...>::mask;
+
+	static inline uint8_t received () __attribute__((always_inline))
+	{
+		return (bit_is_set (*psfr8_t (TUART::crsax), RXC0) ? _BV(TUART::index) : 0) |
+			UartSetBits<TREST...>::received();
+	}
+};
+
+
+//! \brief Reports which of a group of UARTs have received data
+//! \details For a dispatcher serving several ports.  Bit n of the result
+//! is set for UARTn, so only the ports with work need be visited:
+//! \code
+//! struct SetOptions : UartOptions { static const bool rxPending = true; };
+//! Uart<UART2, 32, 0, SetOptions> radio;
+//! UartSet<UART0, UART1, UART2, UART3> ports;
+//! uint8_t ready = ports.pending();
+//! if (ready & _BV(UART2::index))
+//! 	handleRadio (radio.read());
+//! \endcode
+//! pending() is a single load from uartRxPending, which the receive
+//! interrupt of each Uart with a receive queue and the rxPending option keeps
+//! up to date, so its cost does not grow with the number of ports.  Other
+//! ports never show in pending(); received() reads the hardware flag of
+//! every port in the set instead.
+//! \tparam TUARTS The predefined objects UART_0, UART_1, UART_2 or UART_3
+template <class... TUARTS>
+class UartSet
+{
+public:
+	//! \brief The bits of the UARTs in the set
+	static const uint8_t mask = UartSetBits<TUARTS...>::mask;
+
+	//! \brief Gets the ports whose receive queues hold data
+	static inline uint8_t pending () __attribute__((always_inline))
+	{
+		return uartRxPending & mask;
+	}
+
+
+	//! \brief Gets the ports with an unread byte in the receive data register
+	//! \details For ports without a receive queue; reads each port's UCSRnA.
+	static inline uint8_t received () __attribute__((always_inline))
+	{
+		return UartSetBits<TUARTS...>::received();
+	}
+
+
+	//! \brief Waits for at least one port to have data in its receive queue
+	//! \returns The ports whose receive queues hold data
+	static uint8_t wait ()
+	{
+		uint8_t ready;
+		while ((ready = pending()) == 0)
+			;
+		return ready;
+	}
+};
+
+
+#endif /* UARTSET_H_ */
@@ -0,0 +1,243 @@
+//***************************************************************************
+//
+//  File Name :		uartspi.h
+//
+//  Project :		Library for the Atmel 8 bit AVR MCU
+//
+//  Purpose :		Encapsulates the USART in master SPI mode (MSPIM)
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013-2016 Andy Burgess
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//  Revisions :
+//
+//      see rcs below
+//
+//***************************************************************************
+
+
+#ifndef UARTSPI_H_
+#define UARTSPI_H_
+
+#include <uart.h>
+#include "spiMaster.h"
+
+
+//! \brief The XCK (SCK) pin of each USART
+//! \details Specialised below for each supported processor.  In master SPI
+//! mode TXD is MOSI and RXD is MISO.
+template <class TUART>
+struct UartXck;
+
+#if defined(__AVR_ATmega48__) | defined(__AVR_ATmega88__) | defined(__AVR_ATmega168__) | \
+defined(__AVR_ATmega48P__) | defined(__AVR_ATmega88P__) | defined(__AVR_ATmega168P__) | defined(__AVR_ATmega328P__)
+template <> struct UartXck<UART0> { static const uint8_t pin = FASTIOPIN_D4; };
+#endif
+
+#if defined(__AVR_ATmega164P__) | defined(__AVR_ATmega324P__) | \
+defined(__AVR_ATmega644P__) | defined(__AVR_ATmega1284P__) | defined(__AVR_ATmega1284__)
+template <> struct UartXck<UART0> { static const uint8_t pin = FASTIOPIN_B0; };
+template <> struct UartXck<UART1> { static const uint8_t pin = FASTIOPIN_D4; };
+#endif
+
+#if defined(__AVR_ATmega640__) | defined(__AVR_ATmega1280__) | defined(__AVR_ATmega2560__)
+template <> struct UartXck<UART0> { static const uint8_t pin = FASTIOPIN_E2; };
+template <> struct UartXck<UART1> { static const uint8_t pin = FASTIOPIN_D5; };
+template <> struct UartXck<UART2> { static const uint8_t pin = FASTIOPIN_H2; };
+template <> struct UartXck<UART3> { static const uint8_t pin = FASTIOPIN_J2; };
+#endif
+
+
+//! \brief A template class to use a USART as an SPI master
+//! \details In master SPI mode the USART keeps its double buffered
+//! transmitter, so the next byte can be written while the current one is
+//! shifted out and the clock runs without a gap between bytes.  This should
+//! make block transfers faster than SpiMaster, by an estimate from cycle
+//! counts that has not been measured, and gives a second, independent
+//! SPI bus.  Slave select is left to the caller, as with SpiMaster.
+//! \code
+//! UartSpiMaster<UART1> sd;
+//! sd.init();
+//! sd.setClock<F_CPU, 4000000>();
+//! sd.transfer(command, response, sizeof(command));
+//! \endcode
+//! \tparam TUART One of the predefined objects UART_0, UART_1, UART_2 or UART_3
+//! \tparam XCKPIN The FASTIOPIN of the USART clock pin, which is defaulted
+//! for the supported processors
+template <class TUART, uint8_t XCKPIN = UartXck<TUART>::pin>
+class UartSpiMaster
+{
+private:
+	FastIOOutputPin<XCKPIN> xck;
+
+public:
+	//! \brief Initialises a new instance of the UartSpiMaster class
+	//! \details XCK is made an output, which selects master mode
+	inline UartSpiMaster () __attribute__((always_inline)) { }
+
+
+	//! \brief Initialises the USART in master SPI mode
+	//! \details The transmitter and receiver are enabled with the baudrate
+	//! register at zero, as the datasheet requires, and the clock is then set
+	//! to F_CPU/16.  Call setClock() to change it.
+	//! \param mode One of the 4 SPI modes, SPI_MODE0, SPI_MODE1, SPI_MODE2, SPI_MODE3
+	//! \param order One of the 2 SPI bit order modes, SPI_MSBFIRST or SPI_LSBFIRST
+	inline void init (spiModes_t mode = SPI_MODE0, spiOrder_t order = SPI_MSBFIRST) __attribute__((always_inline))
+	{
+		*psfr16_t (TUART::ubrrx) = 0;
+		*psfr8_t (TUART::crscx) = _BV(UMSEL01) | _BV(UMSEL00) | modeBits (mode) | orderBits (order);
+		*psfr8_t (TUART::crsbx) = _BV(RXEN0) | _BV(TXEN0);
+		setClock<F_CPU, F_CPU / 16>();
+	}
+
+
+	//! \brief Sets the SPI clock
+	//! \details SCK is F_CPU / (2 * (UBRR + 1)), so the fastest clock is
+	//! F_CPU/2.  The nearest rate that does not exceed RATE is used.
+	//! \tparam FCPU The CPU clock frequency, normally F_CPU
+	//! \tparam RATE The required SCK frequency
+	template <uint32_t FCPU, uint32_t RATE>
+	__attribute__ ((always_inline)) inline void setClock ()
+	{
+		static_assert(RATE != 0 && RATE <= FCPU / 2, "SPI clock must be F_CPU/2 or less");
+		static_assert((FCPU + 2 * RATE - 1) / (2 * RATE) - 1 <= 4095, "SPI clock is too slow for this CPU clock");
+
+		*psfr16_t (TUART::ubrrx) = (FCPU + 2 * RATE - 1) / (2 * RATE) - 1;
+	}
+
+
+	//! \brief Sets the clock polarity and phase
+	//! \param mode One of the 4 SPI modes, SPI_MODE0, SPI_MODE1, SPI_MODE2, SPI_MODE3
+	inline void setMode (spiModes_t mode) __attribute__((always_inline))
+	{
+		*psfr8_t (TUART::crscx) = (*psfr8_t (TUART::crscx) & ~(_BV(UCPHA0) | _BV(UCPOL0))) | modeBits (mode);
+	}
+
+
+	//! \brief Sets the bit order
+	//! \param order One of the 2 SPI bit order modes, SPI_MSBFIRST or SPI_LSBFIRST
+	inline void setOrder (spiOrder_t order) __attribute__((always_inline))
+	{
+		*psfr8_t (TUART::crscx) = (*psfr8_t (TUART::crscx) & ~_BV(UDORD0)) | orderBits (order);
+	}
+
+
+	//! \brief Exchanges a single byte of data
+	//! \param data The data to transmit to the slave
+	//! \returns The data received from the slave
+	inline uint8_t transfer (uint8_t data) __attribute__((always_inline))
+	{
+		while (bit_is_clear (*psfr8_t (TUART::crsax), UDRE0))
+			;
+		*psfr8_t (TUART::datax) = data;
+
+		while (bit_is_clear (*psfr8_t (TUART::crsax), RXC0))
+			;
+		return *psfr8_t (TUART::datax);
+	}
+
+
+	//! \brief Exchanges blocks of data
+	//! \details The next byte is written as soon as the transmit buffer is
+	//! free, before the byte received for the previous one is read, so the
+	//! clock does not stop between bytes.  The receive buffer is two bytes
+	//! deep, so nothing is lost.
+	//! \param txBuf Pointer to the data to send to the slave
+	//! \param rxBuf Pointer to a data area for the bytes received from the
+	//! slave, which may be the same as txBuf
+	//! \param count The number of bytes to exchange
+	void transfer (const uint8_t * txBuf, uint8_t * rxBuf, uint8_t count)
+	{
+		if (!count)
+			return;
+
+		flushRx ();
+		*psfr8_t (TUART::datax) = *txBuf++;
+
+		while (--count)
+		{
+			while (bit_is_clear (*psfr8_t (TUART::crsax), UDRE0))
+				;
+			*psfr8_t (TUART::datax) = *txBuf++;
+
+			while (bit_is_clear (*psfr8_t (TUART::crsax), RXC0))
+				;
+			*rxBuf++ = *psfr8_t (TUART::datax);
+		}
+
+		while (bit_is_clear (*psfr8_t (TUART::crsax), RXC0))
+			;
+		*rxBuf = *psfr8_t (TUART::datax);
+	}
+
+
+	//! \brief Sends a block of data, discarding what is received
+	//! \details Only waits for the transmit buffer, so the clock runs
+	//! continuously.  Returns once the last byte has been shifted out.
+	//! \param txBuf Pointer to the data to send to the slave
+	//! \param count The number of bytes to send
+	void write (const uint8_t * txBuf, uint8_t count)
+	{
+		if (!count)
+			return;
+
+		// clear TXC so the end of the last byte can be seen
+		*psfr8_t (TUART::crsax) |= _BV(TXC0);
+
+		while (count--)
+		{
+			while (bit_is_clear (*psfr8_t (TUART::crsax), UDRE0))
+				;
+			*psfr8_t (TUART::datax) = *txBuf++;
+		}
+
+		while (bit_is_clear (*psfr8_t (TUART::crsax), TXC0))
+			;
+		flushRx ();
+	}
+
+
+private:
+	// discards any bytes in the receive buffer
+	inline void flushRx () __attribute__((always_inline))
+	{
+		while (bit_is_set (*psfr8_t (TUART::crsax), RXC0))
+			(void) *psfr8_t (TUART::datax);
+	}
+
+
+	// UCSRnC bits for the SPI mode; CPOL is bit 1 and CPHA bit 0 of the mode
+	static inline uint8_t modeBits (spiModes_t mode) __attribute__((always_inline))
+	{
+		return (mode & 0x02 ? _BV(UCPOL0) : 0) | (mode & 0x01 ? _BV(UCPHA0) : 0);
+	}
+
+
+	// UCSRnC bits for the bit order
+	static inline uint8_t orderBits (spiOrder_t order) __attribute__((always_inline))
+	{
+		return order == SPI_LSBFIRST ? _BV(UDORD0) : 0;
+	}
+};
+
+
+#endif /* UARTSPI_H_ */
@@ -0,0 +1,236 @@
+//***************************************************************************
+//
+//  File Name :		uarttimestamp.h
+//
+//  Project :		Library for the Atmel 8 bit AVR MCU
+//
+//  Purpose :		Arrival time of frames received by the UART
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013-2016 Andy Burgess
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//  Revisions :
+//
+//      see rcs below
+//
+//***************************************************************************
+
+
+#ifndef UARTTIMESTAMP_H_
+#define UARTTIMESTAMP_H_
+
+#include <uart.h>
+#include <timer16.h>
+// the timer headers leave the SFR macros as plain addresses
+#include <avr/io.h>
+
+
+//! \brief A free running 16 bit timer as the clock for UartTimestamp
+//! \details The timer is set up by the caller; its prescaler sets the
+//! resolution.  An idle gap longer than the timer period can be mistaken
+//! for a short one, see UartClock32.
+//! \tparam TTIMER16 One of the predefined objects TIMER1, TIMER3, TIMER4 or TIMER5
+template <class TTIMER16>
+struct UartClock16
+{
+	typedef uint16_t tick_t;
+
+	//! \brief Gets the current count
+	static inline tick_t now () __attribute__((always_inline))
+	{
+		return Timer16<TTIMER16>().read();
+	}
+};
+
+
+//! \brief A 16 bit timer extended to 32 bits by its overflow interrupt
+//! \details Call overflowIsr() from the TIMERn_OVF_vect interrupt routine;
+//! the overflow interrupt must be enabled.  One clock can be shared by
+//! several UARTs.
+//! \tparam TTIMER16 One of the predefined objects TIMER1, TIMER3, TIMER4 or TIMER5
+template <class TTIMER16>
+struct UartClock32
+{
+	typedef uint32_t tick_t;
+
+	static volatile uint16_t high;
+
+	//! \brief Timer overflow interrupt handler
+	static inline void overflowIsr () __attribute__((always_inline))
+	{
+		high++;
+	}
+
+	//! \brief Gets the current count
+	//! \details Call with interrupts disabled.  An overflow that has not yet
+	//! been counted by the interrupt is allowed for.
+	static inline tick_t now () __attribute__((always_inline))
+	{
+		Timer16<TTIMER16> timer;
+		uint16_t low = timer.read();
+		uint16_t upper = high;
+
+		if (timer.getOverFlow() && low < 0x8000)
+			upper++;
+		return (tick_t (upper) << 16) | low;
+	}
+};
+
+template <class TTIMER16>
+volatile uint16_t UartClock32<TTIMER16>::high;
+
+
+//! \brief Records when each frame received by a Uart began
+//! \details Give it to Uart as the timestamp option.  The receive interrupt
+//! reads the clock for every byte, and when the time since the previous
+//! byte is at least GAP it records the count as the start of a new frame.
+//! The jitter is therefore the latency of the receive interrupt, not of the
+//! main code.  Uart::readFrame() returns a frame with its time.
+//! \code
+//! typedef UartClock32<TIMER1> Clock;
+//! struct TimedOptions : UartOptions
+//! {
+//! 	typedef UartTimestamp<Clock, 200> timestamp;	// 200 ticks idle
+//! };
+//! Uart<UART1, 64, 0, TimedOptions> sniffer;
+//! ISR(USART1_RX_vect) { sniffer.rxCompleteIsr(); }
+//! ISR(TIMER1_OVF_vect) { Clock::overflowIsr(); }
+//!
+//! uint32_t when;
+//! uint8_t length = sniffer.readFrame (frame, sizeof(frame), when);
+//! \endcode
+//! Up to DEPTH frame starts are held; if more frames are waiting than that
+//! the later ones are not marked and join the frame before them.
+//! \tparam TCLOCK UartClock16 or UartClock32
+//! \tparam GAP The idle time, in clock ticks, that separates frames
+//! \tparam DEPTH The number of frame starts held, a power of two
+template <class TCLOCK, typename TCLOCK::tick_t GAP, uint8_t DEPTH = 4>
+class UartTimestamp
+{
+public:
+	static const bool enabled = true;
+	typedef typename TCLOCK::tick_t tick_t;
+
+private:
+	static_assert((DEPTH & (DEPTH - 1)) == 0 && DEPTH <= 128, "UartTimestamp DEPTH must be a power of two");
+
+	tick_t times [DEPTH];
+	uint8_t starts [DEPTH];			// the byte number at which each frame starts
+	volatile uint8_t head;			// written by the interrupt
+	volatile uint8_t tail;
+	volatile tick_t last;			// when the last byte arrived
+	uint8_t queued;					// bytes put in the receive queue
+	uint8_t taken;					// bytes taken from the receive queue
+	bool started;
+
+public:
+	inline UartTimestamp () __attribute__((always_inline)) :
+		head(0), tail(0), last(0), queued(0), taken(0), started(false) { }
+
+
+	// called by the receive interrupt when a byte has been queued
+	inline void received () __attribute__((always_inline))
+	{
+		tick_t now = TCLOCK::now();
+
+		if (!started || tick_t (now - last) >= GAP)
+		{
+			if (uint8_t (head - tail) < DEPTH)
+			{
+				times[head & (DEPTH - 1)] = now;
+				starts[head & (DEPTH - 1)] = queued;
+				head++;
+			}
+			started = true;
+		}
+		last = now;
+		queued++;
+	}
+
+
+	// called when a byte has been taken from the receive queue
+	inline void consumed () __attribute__((always_inline))
+	{
+		taken++;
+	}
+
+
+	// called with interrupts disabled when the receive queue is emptied
+	inline void clear () __attribute__((always_inline))
+	{
+		taken = queued;
+		tail = head;
+	}
+
+
+	template <class TPORT>
+	uint8_t readFrame (TPORT & port, uint8_t * buffer, uint8_t size, tick_t & time)
+	{
+		// skip to the next frame start, dropping starts already read past
+		for (;;)
+		{
+			if (tail != head)
+			{
+				int8_t ahead = starts[tail & (DEPTH - 1)] - taken;
+				if (ahead == 0)
+					break;
+				if (ahead < 0)
+				{
+					tail++;
+					continue;
+				}
+			}
+			if (port.available())
+				port.read();
+		}
+
+		time = times[tail & (DEPTH - 1)];
+		tail++;
+
+		uint8_t count = 0;
+		for (;;)
+		{
+			if (tail != head && starts[tail & (DEPTH - 1)] == taken)
+				break;
+
+			if (port.available())
+			{
+				uint8_t data = port.read();
+				if (count < size)
+					buffer[count++] = data;
+				continue;
+			}
+
+			bool idle;
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+			{
+				idle = tick_t (TCLOCK::now() - last) >= GAP;
+			}
+			if (idle && !port.available())
+				break;
+		}
+		return count;
+	}
+};
+
+
+#endif /* UARTTIMESTAMP_H_ */
@@ -0,0 +1,2 @@
+// The library includes FastIO.h by this name; the file is src/fastio.h.
+#include "../../src/fastio.h"
@@ -0,0 +1,2 @@
+// The library includes FastIOPin.h by this name; the file is src/fastiopin.h.
+#include "../../src/fastiopin.h"
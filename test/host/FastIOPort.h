@@ -0,0 +1,2 @@
+// The library includes FastIOPort.h by this name; the file is src/fastioport.h.
+#include "../../src/fastioport.h"
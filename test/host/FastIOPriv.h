@@ -0,0 +1,2 @@
+// The library includes FastIOPriv.h by this name; the file is src/fastiopriv.h.
+#include "../../src/fastiopriv.h"
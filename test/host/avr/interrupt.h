@@ -0,0 +1,9 @@
+// Host stand in for <avr/interrupt.h>; a harness calls the handlers itself.
+#ifndef _AVR_INTERRUPT_H_
+#define _AVR_INTERRUPT_H_
+
+#define sei() __asm__ __volatile__ ("" ::: "memory")
+#define cli() __asm__ __volatile__ ("" ::: "memory")
+#define ISR(vector, ...) extern "C" void vector (void); void vector (void)
+
+#endif
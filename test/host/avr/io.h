@@ -0,0 +1,103 @@
+// Host stand in for <avr/io.h>: the ATmega2560 registers the harnesses use.
+// A harness may add registers of another part, such as the USI, before
+// including the library.
+#ifndef _AVR_IO_H_
+#define _AVR_IO_H_
+
+#include <avr/sfr_defs.h>
+
+#ifndef _AVR_IOXXX_H_
+#define _AVR_IOXXX_H_
+
+#define __AVR_ATmega2560__ 1
+#define RAMEND 0x21FF
+
+#define SREG _SFR_IO8(0x3F)
+#define SREG_I 7
+#define SMCR _SFR_IO8(0x33)
+#define SE 0
+
+#define PINA _SFR_IO8(0x00)
+#define DDRA _SFR_IO8(0x01)
+#define PORTA _SFR_IO8(0x02)
+#define PINB _SFR_IO8(0x03)
+#define DDRB _SFR_IO8(0x04)
+#define PORTB _SFR_IO8(0x05)
+#define PINC _SFR_IO8(0x06)
+#define DDRC _SFR_IO8(0x07)
+#define PORTC _SFR_IO8(0x08)
+#define PIND _SFR_IO8(0x09)
+#define DDRD _SFR_IO8(0x0A)
+#define PORTD _SFR_IO8(0x0B)
+#define PINE _SFR_IO8(0x0C)
+#define DDRE _SFR_IO8(0x0D)
+#define PORTE _SFR_IO8(0x0E)
+#define PINF _SFR_IO8(0x0F)
+#define DDRF _SFR_IO8(0x10)
+#define PORTF _SFR_IO8(0x11)
+#define PING _SFR_IO8(0x12)
+#define DDRG _SFR_IO8(0x13)
+#define PORTG _SFR_IO8(0x14)
+#define PINH _SFR_MEM8(0x100)
+#define DDRH _SFR_MEM8(0x101)
+#define PORTH _SFR_MEM8(0x102)
+#define PINJ _SFR_MEM8(0x103)
+#define DDRJ _SFR_MEM8(0x104)
+#define PORTJ _SFR_MEM8(0x105)
+#define PINK _SFR_MEM8(0x106)
+#define DDRK _SFR_MEM8(0x107)
+#define PORTK _SFR_MEM8(0x108)
+#define PINL _SFR_MEM8(0x109)
+#define DDRL _SFR_MEM8(0x10A)
+#define PORTL _SFR_MEM8(0x10B)
+
+#define UCSR0A _SFR_MEM8(0xC0)
+#define UCSR0B _SFR_MEM8(0xC1)
+#define UCSR0C _SFR_MEM8(0xC2)
+#define UBRR0 _SFR_MEM16(0xC4)
+#define UDR0 _SFR_MEM8(0xC6)
+#define UCSR1A _SFR_MEM8(0xC8)
+#define UCSR1B _SFR_MEM8(0xC9)
+#define UCSR1C _SFR_MEM8(0xCA)
+#define UBRR1 _SFR_MEM16(0xCC)
+#define UDR1 _SFR_MEM8(0xCE)
+#define UCSR2A _SFR_MEM8(0xD0)
+#define UCSR2B _SFR_MEM8(0xD1)
+#define UCSR2C _SFR_MEM8(0xD2)
+#define UBRR2 _SFR_MEM16(0xD4)
+#define UDR2 _SFR_MEM8(0xD6)
+#define UCSR3A _SFR_MEM8(0x130)
+#define UCSR3B _SFR_MEM8(0x131)
+#define UCSR3C _SFR_MEM8(0x132)
+#define UBRR3 _SFR_MEM16(0x134)
+#define UDR3 _SFR_MEM8(0x136)
+
+#define RXC0 7
+#define TXC0 6
+#define UDRE0 5
+#define FE0 4
+#define DOR0 3
+#define UPE0 2
+#define U2X0 1
+#define MPCM0 0
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0 4
+#define TXEN0 3
+#define UCSZ02 2
+#define RXB80 1
+#define TXB80 0
+#define UMSEL01 7
+#define UMSEL00 6
+#define UPM01 5
+#define UPM00 4
+#define USBS0 3
+#define UCSZ01 2
+#define UDORD0 2
+#define UCSZ00 1
+#define UCPHA0 1
+#define UCPOL0 0
+
+#endif
+#endif
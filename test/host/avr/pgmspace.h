@@ -0,0 +1,20 @@
+// Host stand in for <avr/pgmspace.h>; flash is ordinary memory.
+#ifndef __PGMSPACE_H_
+#define __PGMSPACE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+#define pgm_read_ptr(address) (*(void * const *)(address))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define fputs_P fputs
+
+#endif
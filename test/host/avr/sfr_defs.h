@@ -0,0 +1,38 @@
+// Host stand in for <avr/sfr_defs.h>.  Registers are plain memory at their
+// data space address, which hostsim.h maps at address zero.  The
+// _SFR_ASM_COMPAT form gives the bare addresses the private headers use.
+#ifndef _AVR_SFR_DEFS_H_
+#define _AVR_SFR_DEFS_H_
+
+#include <stdint.h>
+
+#undef _SFR_MEM8
+#undef _SFR_MEM16
+#undef _SFR_IO8
+#undef _SFR_BYTE
+#undef _SFR_WORD
+
+#if _SFR_ASM_COMPAT
+#define _SFR_MEM8(a) (a)
+#define _SFR_MEM16(a) (a)
+#define _SFR_IO8(a) ((a) + 0x20)
+#define _SFR_BYTE(sfr) (*(volatile uint8_t *)(uintptr_t)(sfr))
+#define _SFR_WORD(sfr) (*(volatile uint16_t *)(uintptr_t)(sfr))
+#else
+#define _SFR_MEM8(a) (*(volatile uint8_t *)(uintptr_t)(a))
+#define _SFR_MEM16(a) (*(volatile uint16_t *)(uintptr_t)(a))
+#define _SFR_IO8(a) (*(volatile uint8_t *)(uintptr_t)((a) + 0x20))
+#define _SFR_BYTE(sfr) (sfr)
+#define _SFR_WORD(sfr) (sfr)
+#endif
+
+#ifndef _BV
+#define _BV(bit) (1 << (bit))
+#endif
+
+#define bit_is_set(sfr, bit) (_SFR_BYTE(sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!(_SFR_BYTE(sfr) & _BV(bit)))
+#define loop_until_bit_is_set(sfr, bit) do { } while (bit_is_clear(sfr, bit))
+#define loop_until_bit_is_clear(sfr, bit) do { } while (bit_is_set(sfr, bit))
+
+#endif
@@ -0,0 +1,12 @@
+// Host stand in for <avr/sleep.h>; sleeping does nothing.
+#ifndef _AVR_SLEEP_H_
+#define _AVR_SLEEP_H_
+
+#define SLEEP_MODE_IDLE 0
+#define set_sleep_mode(mode) do { } while (0)
+#define sleep_enable() do { } while (0)
+#define sleep_disable() do { } while (0)
+#define sleep_cpu() do { } while (0)
+#define sleep_mode() do { } while (0)
+
+#endif
@@ -0,0 +1,2 @@
+// The library includes commondefs.h by this name; the file is src/CommonDefs.h.
+#include "../../src/CommonDefs.h"
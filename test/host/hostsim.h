@@ -0,0 +1,35 @@
+// Maps the AVR data space at address zero, so the library's registers are
+// plain memory the harness can set and inspect.  Needs permission to map
+// page zero: run as root, or after sysctl vm.mmap_min_addr=0.
+#ifndef HOSTSIM_H_
+#define HOSTSIM_H_
+
+#include <sys/mman.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+__attribute__((constructor(101))) static void hostMapDataSpace ()
+{
+	void * p = mmap ((void *) 0, 0x10000, PROT_READ | PROT_WRITE,
+		MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p != (void *) 0)
+	{
+		perror ("mapping the data space at address 0 (see vm.mmap_min_addr)");
+		exit (2);
+	}
+}
+
+//! \brief A register or RAM byte by its data space address
+#define REG8(address) (*(volatile uint8_t *)(uintptr_t)(address))
+
+static int hostFailures;
+
+//! \brief Reports a failed expectation and counts it
+#define CHECK(expr) do { if (!(expr)) { hostFailures++; \
+	printf ("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr); } } while (0)
+
+//! \brief The exit status for main()
+#define HOST_RESULT() (hostFailures ? 1 : 0)
+
+#endif
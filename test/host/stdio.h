@@ -0,0 +1,7 @@
+// Adds the avr-libc stream return codes to the host <stdio.h>.
+#include_next <stdio.h>
+
+#ifndef _FDEV_EOF
+#define _FDEV_ERR (-1)
+#define _FDEV_EOF (-2)
+#endif
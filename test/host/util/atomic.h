@@ -0,0 +1,12 @@
+// Host stand in for <util/atomic.h>.  The harnesses are single threaded and
+// call the interrupt handlers themselves, so the block just runs once.
+#ifndef _UTIL_ATOMIC_H_
+#define _UTIL_ATOMIC_H_
+
+#define ATOMIC_BLOCK(type) for (uint8_t _atomicOnce = 1; _atomicOnce; _atomicOnce = 0)
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define NONATOMIC_BLOCK(type) for (uint8_t _nonAtomicOnce = 1; _nonAtomicOnce; _nonAtomicOnce = 0)
+#define NONATOMIC_RESTORESTATE
+
+#endif
@@ -0,0 +1,8 @@
+// Host stand in for <util/delay.h>; delays take no time.
+#ifndef _UTIL_DELAY_H_
+#define _UTIL_DELAY_H_
+
+#define _delay_us(us) do { } while (0)
+#define _delay_ms(ms) do { } while (0)
+
+#endif
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Builds each host harness in this directory with the host g++ and runs it.
+# The harnesses map the AVR data space at address zero, so this needs root
+# or vm.mmap_min_addr=0.
+cd "$(dirname "$0")" || exit 1
+CXX=${CXX:-g++}
+OUT=${TMPDIR:-/tmp}/avrlib-test
+mkdir -p "$OUT"
+
+status=0
+for source in *.cpp
+do
+	name=${source%.cpp}
+	if $CXX -std=gnu++11 -Wall -DF_CPU=16000000UL -I../src -Ihost -o "$OUT/$name" "$source" && "$OUT/$name"
+	then
+		echo "PASS $name"
+	else
+		echo "FAIL $name"
+		status=1
+	fi
+done
+exit $status
@@ -0,0 +1,158 @@
+// Host harness for the USI TwiSlave: a simulated master steps the start and
+// counter overflow handlers byte by byte, as the USI counter would raise
+// them.  It checks the protocol only; the bus timing is not modelled.
+#include "hostsim.h"
+#include <avr/io.h>
+
+// the ATtiny85 USI, which the ATmega2560 registers of the host io.h lack
+#define USICR _SFR_MEM8(0x2D)
+#define USISR _SFR_MEM8(0x2E)
+#define USIDR _SFR_MEM8(0x2F)
+#define USISIE 7
+#define USIOIE 6
+#define USIWM1 5
+#define USIWM0 4
+#define USICS1 3
+#define USICS0 2
+#define USICLK 1
+#define USITC 0
+#define USISIF 7
+#define USIOIF 6
+#define USIPF 5
+#define USIDC 4
+#define USICNT0 0
+
+#define SDAPIN FASTIOPIN_B0
+#define SCLPIN FASTIOPIN_B2
+
+#include <FastIO.h>
+#include <twiSlaveUsi.h>
+
+
+// the USICR settings the slave uses
+const uint8_t waitStart = 0xA8;			// start interrupt only
+const uint8_t running = 0xF8;			// start and overflow, SCL held
+
+volatile uint8_t registers[4] = { 0xA0, 0xA1, 0xA2, 0xA3 };
+TwiSlave slave;
+
+uint8_t writtenFirst, writtenCount, writeCalls;
+
+
+static void written (uint8_t first, uint8_t count)
+{
+	writtenFirst = first;
+	writtenCount = count;
+	writeCalls++;
+}
+
+
+static bool sdaDriven ()
+{
+	return REG8(0x24) & _BV(0);			// DDRB0
+}
+
+
+static uint8_t counter ()
+{
+	return USISR & 0x0f;
+}
+
+
+static void masterStart ()
+{
+	REG8(0x23) = 0;						// PINB: SCL and SDA low
+	slave.startIsr();
+	CHECK(USICR == running && counter() == 0);
+}
+
+
+static void masterStop ()
+{
+	USISR |= _BV(USIPF);
+	slave.checkStop();
+	CHECK(USICR == waitStart);
+}
+
+
+// the master sends a byte and clocks the ACK bit; true if the slave ACKed
+static bool masterWrite (uint8_t data)
+{
+	if (USICR != running || counter() != 0)
+		return false;
+
+	USIDR = data;
+	slave.overflowIsr();				// 8 bits in
+	bool ack = counter() == 0x0e && sdaDriven() && USIDR == 0;
+	slave.overflowIsr();				// the ACK bit out
+	return ack;
+}
+
+
+// the master clocks a byte out of the slave and answers with ACK or NAK
+static uint8_t masterRead (bool nak)
+{
+	CHECK(counter() == 0 && sdaDriven());
+	uint8_t data = USIDR;
+	slave.overflowIsr();				// 8 bits out
+	CHECK(counter() == 0x0e && !sdaDriven());
+	USIDR = nak ? 1 : 0;
+	slave.overflowIsr();				// the ACK bit in
+	return data;
+}
+
+
+int main ()
+{
+	slave.setWriteCallback (written);
+	slave.init (0x42, registers, 4);
+	CHECK(USICR == waitStart);
+
+	// S 0x42+W reg 2, three data bytes wrapping round the file, P
+	masterStart();
+	CHECK(masterWrite (0x84));
+	CHECK(masterWrite (2));
+	CHECK(masterWrite (0x55));
+	CHECK(masterWrite (0x66));
+	CHECK(masterWrite (0x77));
+	CHECK(writeCalls == 0);
+	masterStop();
+	CHECK(registers[2] == 0x55 && registers[3] == 0x66 && registers[0] == 0x77);
+	CHECK(registers[1] == 0xA1);
+	CHECK(writeCalls == 1 && writtenFirst == 2 && writtenCount == 3);
+
+	// S 0x42+W reg 1 Sr 0x42+R, three bytes read, the last NAKed
+	masterStart();
+	CHECK(masterWrite (0x84));
+	CHECK(masterWrite (1));
+	masterStart();
+	CHECK(writeCalls == 1);				// only the pointer was written
+	CHECK(masterWrite (0x85));
+	CHECK(masterRead (false) == 0xA1);
+	CHECK(masterRead (false) == 0x55);
+	CHECK(masterRead (true) == 0x66);
+	CHECK(USICR == waitStart && !sdaDriven());
+
+	// a read on its own carries on from where the last one stopped
+	masterStart();
+	CHECK(masterWrite (0x85));
+	CHECK(masterRead (true) == 0x77);
+
+	// another device's address is not acknowledged and the slave lets go
+	masterStart();
+	CHECK(!masterWrite (0x90));
+	CHECK(USICR == waitStart && !sdaDriven());
+
+	// the general call address only when asked for
+	masterStart();
+	CHECK(!masterWrite (0x00));
+	slave.init (0x42, registers, 4, true);
+	masterStart();
+	CHECK(masterWrite (0x00));
+	CHECK(masterWrite (3));
+	CHECK(masterWrite (0x99));
+	masterStop();
+	CHECK(registers[3] == 0x99 && writtenFirst == 3 && writtenCount == 1);
+
+	return HOST_RESULT();
+}
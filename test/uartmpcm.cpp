@@ -0,0 +1,182 @@
+// Host harness for multiprocessor communication mode: a bus model with one
+// master and three nodes, each node's receiver ignoring data frames while
+// its MPCM bit is set as the hardware does.
+#include "hostsim.h"
+#include <uart.h>
+
+
+struct BusOptions : UartOptions
+{
+	static const bool multiprocessor = true;
+};
+
+Uart<UART0, 0, 0, BusOptions> master;
+Uart<UART1, 32, 0, BusOptions> node1;
+Uart<UART2, 32, 0, BusOptions> node2;
+Uart<UART3, 32, 0, BusOptions> node3;
+
+
+// a node on the bus, by its register addresses
+struct Station
+{
+	uint16_t csra;
+	uint16_t csrb;
+	uint16_t udr;
+	uint8_t address;
+	void (*isr) ();
+	uint8_t (*available) ();
+	uint8_t (*read) ();
+	void (*waitForAddress) ();
+	uint16_t interrupts;				// receive interrupts raised
+	uint16_t expectedInterrupts;
+	uint8_t received[4096];				// everything read by the main line
+	uint16_t receivedCount;
+	uint8_t expected[4096];				// the data addressed to this node
+	uint16_t expectedCount;
+};
+
+Station stations[] =
+{
+	{ 0xC8, 0xC9, 0xCE, 1, [] { node1.rxCompleteIsr(); }, [] { return node1.available(); },
+		[] { return node1.read(); }, [] { node1.waitForAddress(); } },
+	{ 0xD0, 0xD1, 0xD6, 2, [] { node2.rxCompleteIsr(); }, [] { return node2.available(); },
+		[] { return node2.read(); }, [] { node2.waitForAddress(); } },
+	{ 0x130, 0x131, 0x136, 3, [] { node3.rxCompleteIsr(); }, [] { return node3.available(); },
+		[] { return node3.read(); }, [] { node3.waitForAddress(); } },
+};
+const uint8_t stationCount = sizeof (stations) / sizeof (stations[0]);
+
+
+// puts a frame on the bus; a receiver with MPCM set raises no interrupt
+// for a data frame
+static void busFrame (uint16_t frame)
+{
+	for (uint8_t i = 0; i < stationCount; i++)
+	{
+		Station & s = stations[i];
+		if ((REG8(s.csra) & _BV(MPCM0)) && !(frame & 0x100))
+			continue;
+
+		if (frame & 0x100)
+			REG8(s.csrb) |= _BV(RXB80);
+		else
+			REG8(s.csrb) &= ~_BV(RXB80);
+		REG8(s.udr) = frame;
+		s.interrupts++;
+		s.isr();
+	}
+}
+
+
+// the frame the master has just written, with TXB8 as the ninth bit
+static uint16_t masterFrame ()
+{
+	return REG8(0xC6) | (bit_is_set (REG8(0xC1), TXB80) ? 0x100 : 0);
+}
+
+
+static void sendAddress (uint8_t address)
+{
+	REG8(0xC0) = _BV(UDRE0);
+	master.writeAddress (address);
+	CHECK(masterFrame() == (0x100 | address));
+	busFrame (masterFrame());
+
+	for (uint8_t i = 0; i < stationCount; i++)
+		stations[i].expectedInterrupts++;
+}
+
+
+static void sendData (uint8_t address, uint8_t data)
+{
+	REG8(0xC0) = _BV(UDRE0);
+	master.write (data);
+	CHECK(masterFrame() == data);
+	busFrame (masterFrame());
+
+	for (uint8_t i = 0; i < stationCount; i++)
+	{
+		Station & s = stations[i];
+		if (s.address == address)
+		{
+			s.expectedInterrupts++;
+			s.expected[s.expectedCount++] = data;
+		}
+	}
+}
+
+
+// each node's main loop reads whatever it has been sent
+static void drain ()
+{
+	for (uint8_t i = 0; i < stationCount; i++)
+	{
+		Station & s = stations[i];
+		while (s.available())
+			s.received[s.receivedCount++] = s.read();
+	}
+}
+
+
+int main ()
+{
+	master.init();
+	master.setDataBits (databit9);
+	node1.init();
+	node1.setAddress (1);
+	node2.init();
+	node2.setAddress (2);
+	node3.init();
+	node3.setAddress (3);
+
+	for (uint8_t i = 0; i < stationCount; i++)
+		CHECK(REG8(stations[i].csra) & _BV(MPCM0));
+	CHECK(!node1.isAddressed() && !node2.isAddressed() && !node3.isAddressed());
+
+	// one message to node 2: the others see only the address frame
+	sendAddress (2);
+	CHECK(!node1.isAddressed() && node2.isAddressed() && !node3.isAddressed());
+	for (uint8_t i = 0; i < 5; i++)
+		sendData (2, 0x20 + i);
+	CHECK(node2.available() == 5);
+	CHECK(stations[0].interrupts == 1 && stations[1].interrupts == 6 && stations[2].interrupts == 1);
+	drain();
+
+	// once node 2 has its message it drops off the bus until addressed again
+	node2.waitForAddress();
+	REG8(0xC0) = _BV(UDRE0);
+	master.write (0x99);
+	busFrame (masterFrame());
+	CHECK(stations[1].interrupts == 6 && node2.available() == 0);
+
+	// an address no node has deselects them all
+	sendAddress (9);
+	sendData (9, 0x55);
+	CHECK(!node1.isAddressed() && !node2.isAddressed() && !node3.isAddressed());
+	CHECK(node1.available() == 0 && node2.available() == 0 && node3.available() == 0);
+
+	// random traffic: each node reads back exactly what was sent to it and
+	// is interrupted only by address frames and its own data
+	uint32_t seed = 7;
+	for (int message = 0; message < 300; message++)
+	{
+		seed = seed * 1103515245 + 12345;
+		uint8_t address = (seed >> 16) % 5;		// 0 and 4 are not nodes
+		uint8_t length = (seed >> 20) % 12;
+		sendAddress (address);
+		for (uint8_t i = 0; i < length; i++)
+			sendData (address, seed >> (i % 24));
+		drain();
+	}
+
+	for (uint8_t i = 0; i < stationCount; i++)
+	{
+		Station & s = stations[i];
+		CHECK(s.interrupts == s.expectedInterrupts);
+		CHECK(s.receivedCount == s.expectedCount);
+		for (uint16_t j = 0; j < s.expectedCount && j < s.receivedCount; j++)
+			CHECK(s.received[j] == s.expected[j]);
+	}
+
+	return HOST_RESULT();
+}
@@ -0,0 +1,111 @@
+// Host harness for the interrupt driven receive queue: replays byte streams
+// through a simulated UDR register and drains them as the main line would.
+#include "hostsim.h"
+#include <uart.h>
+
+#include <string.h>
+
+
+// the UART1 registers
+#define UCSRA REG8(0xC8)
+#define UCSRB REG8(0xC9)
+#define UDR REG8(0xCE)
+
+Uart<UART1, 16> port;
+
+
+// the receive complete interrupt for one byte
+static void receive (uint8_t data)
+{
+	UDR = data;
+	port.rxCompleteIsr();
+}
+
+
+static void ringBufferTests ()
+{
+	RingBuffer<8> queue;
+	CHECK(queue.isEmpty() && queue.count() == 0 && queue.space() == 8);
+
+	// run the free running indices round several times
+	uint8_t in = 0, out = 0;
+	for (int pass = 0; pass < 200; pass++)
+	{
+		uint8_t burst = 1 + pass % 8;
+		for (uint8_t i = 0; i < burst; i++)
+			CHECK(queue.put (in++));
+		CHECK(queue.count() == burst);
+		CHECK(queue.isFull() == (burst == 8));
+		CHECK(queue.peek() == out);
+		while (!queue.isEmpty())
+			CHECK(queue.get() == out++);
+	}
+
+	// a full queue refuses the byte and keeps what it has
+	for (uint8_t i = 0; i < 8; i++)
+		queue.put (i);
+	CHECK(!queue.put (0xff));
+	CHECK(queue.count() == 8 && queue.get() == 0);
+	queue.clear();
+	CHECK(queue.isEmpty());
+
+	// the tag bits follow their bytes round the queue
+	RingBuffer<8, true> tagged;
+	for (int i = 0; i < 40; i++)
+	{
+		tagged.put (i, i % 3 == 0);
+		CHECK(tagged.peekTag() == (i % 3 == 0));
+		CHECK(tagged.get() == i);
+	}
+}
+
+
+static void replayTests ()
+{
+	port.init();
+	CHECK(bit_is_set (UCSRB, RXCIE0));
+	CHECK(port.available() == 0);
+	CHECK(port.getch (0) == _FDEV_EOF);
+
+	// bursts of up to the queue size, each drained a few bytes at a time
+	// while the next is arriving, as a busy main loop would
+	uint8_t sent = 0, expected = 0;
+	uint32_t seed = 1;
+	for (int burst = 0; burst < 500; burst++)
+	{
+		seed = seed * 1103515245 + 12345;
+		uint8_t count = (seed >> 16) % 17;
+		for (uint8_t i = 0; i < count && port.available() < 16; i++)
+			receive (sent++);
+
+		uint8_t reads = (seed >> 24) % 17;
+		while (reads-- && port.available())
+			CHECK(port.read() == expected++);
+	}
+	while (port.available())
+		CHECK(port.read() == expected++);
+	CHECK(expected == sent);
+
+	// bytes arriving at a full queue are lost, not the ones already held
+	for (uint8_t i = 0; i < 20; i++)
+		receive ('a' + i);
+	CHECK(port.available() == 16);
+	char text[17] = { 0 };
+	for (uint8_t i = 0; i < 16; i++)
+		text[i] = port.getch (0);
+	CHECK(strcmp (text, "abcdefghijklmnop") == 0);
+	CHECK(port.getch (0) == _FDEV_EOF);
+
+	// the hardware is not read while the queue is empty
+	UCSRA = _BV(RXC0);
+	CHECK(port.available() == 0);
+	UCSRA = 0;
+}
+
+
+int main ()
+{
+	ringBufferTests();
+	replayTests();
+	return HOST_RESULT();
+}
@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+#***************************************************************************
+#
+#  File Name :		uartlog.py
+#
+#  Project :		Library for the Atmel 8 bit AVR MCU
+#
+#  Purpose :		Host decoder for the binary records of UartLog
+#
+# The MIT License (MIT)
+#
+# Copyright (c) 2013-2016 Andy Burgess
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+#***************************************************************************
+
+"""Decodes the records a UartLog sends, using the firmware's own source.
+
+The format strings are taken from the UART_LOG() calls in the source files
+and hashed with the same FNV-1a fold as uartLogHash() in src/uartlog.h, so
+the table always matches the firmware it was built from.
+
+    uartlog.py --list main.cpp sensors.cpp
+    uartlog.py main.cpp sensors.cpp < capture.bin
+    uartlog.py --input /dev/ttyUSB0 main.cpp sensors.cpp
+
+Set the port's baudrate and raw mode first, for example with stty.
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+
+# a UART_LOG call up to the end of its format, which may be several literals
+CALL = re.compile(r'UART_LOG\s*\(\s*[^,]+,\s*((?:"(?:[^"\\]|\\.)*"\s*)+)', re.S)
+LITERAL = re.compile(r'"((?:[^"\\]|\\.)*)"')
+CONVERSION = re.compile(r'%[-+ #0]*\d*(?:\.\d+)?(hh|h|ll|l)?([diouxXcfeEgGs%])')
+ESCAPES = {'n': 10, 't': 9, 'r': 13, '0': 0, 'a': 7, 'b': 8, 'f': 12, 'v': 11,
+	'\\': 92, '"': 34, "'": 39, '?': 63}
+
+
+def unescape(text):
+	"""Gives the bytes of a C string literal's contents."""
+	out = bytearray()
+	i = 0
+	while i < len(text):
+		c = text[i]
+		i += 1
+		if c != '\\':
+			out += c.encode()
+			continue
+		c = text[i]
+		i += 1
+		if c == 'x':
+			digits = re.match(r'[0-9a-fA-F]+', text[i:]).group()
+			out.append(int(digits, 16) & 0xff)
+			i += len(digits)
+		elif c in '01234567':
+			digits = re.match(r'[0-7]{1,3}', text[i - 1:]).group()
+			out.append(int(digits, 8) & 0xff)
+			i += len(digits) - 1
+		else:
+			out.append(ESCAPES[c])
+	return bytes(out)
+
+
+def log_hash(data):
+	"""The same as uartLogHash(): 32 bit FNV-1a folded to 16 bits."""
+	h = 2166136261
+	for b in data:
+		h = ((h ^ b) * 16777619) & 0xffffffff
+	return (h ^ (h >> 16)) & 0xffff
+
+
+def arguments(fmt):
+	"""Gives the struct codes of the arguments, as promoted on the AVR:
+	int is 16 bits, long 32 bits and double the same as float."""
+	codes = ''
+	for length, conv in CONVERSION.findall(fmt):
+		if conv == '%':
+			continue
+		if conv == 's':
+			raise ValueError('strings cannot be logged')
+		if conv in 'feEgG':
+			codes += 'f'
+		else:
+			code = {'ll': 'q', 'l': 'l'}.get(length, 'h')
+			codes += code if conv in 'di' else code.upper()
+	return '<' + codes
+
+
+def load(paths):
+	"""Builds the table of identity to format from the source files."""
+	table = {}
+	for path in paths:
+		with open(path, encoding='utf-8', errors='replace') as f:
+			source = f.read()
+		for call in CALL.finditer(source):
+			data = b''.join(unescape(s) for s in LITERAL.findall(call.group(1)))
+			fmt = data.decode('latin-1')
+			ident = log_hash(data)
+			if ident in table and table[ident] != fmt:
+				sys.exit('%s: "%s" has the same identity as "%s"; reword one'
+					% (path, fmt, table[ident]))
+			table[ident] = fmt
+	return table
+
+
+def convert(fmt):
+	"""Makes a printf format usable by Python's % operator."""
+	return CONVERSION.sub(lambda m: m.group(0).replace(m.group(1) or '', '', 1)
+		if m.group(2) != '%' else '%%', fmt)
+
+
+def decode(stream, table, out):
+	while True:
+		head = stream.read(1)
+		if not head:
+			return
+		record = stream.read(head[0])
+		if len(record) < head[0] or len(record) < 2:
+			return
+		ident = record[0] | (record[1] << 8)
+		body = record[2:]
+		if ident == 0 and len(body) == 1:
+			out.write('(%u records dropped)\n' % body[0])
+		elif ident not in table:
+			out.write('(unknown %04x: %s)\n' % (ident, body.hex()))
+		else:
+			fmt = table[ident]
+			try:
+				values = struct.unpack(arguments(fmt), body)
+				out.write((convert(fmt) % values).rstrip('\n') + '\n')
+			except (struct.error, ValueError, TypeError) as e:
+				out.write('(bad record %04x "%s": %s)\n' % (ident, fmt, e))
+		out.flush()
+
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__,
+		formatter_class=argparse.RawDescriptionHelpFormatter)
+	parser.add_argument('sources', nargs='+', help='firmware source files')
+	parser.add_argument('--input', help='capture file or serial device; default stdin')
+	parser.add_argument('--list', action='store_true',
+		help='print the identity and argument layout of each message')
+	args = parser.parse_args()
+
+	table = load(args.sources)
+	if args.list:
+		for ident, fmt in sorted(table.items()):
+			print('%04x %-8s %s' % (ident, arguments(fmt)[1:],
+				fmt.encode('unicode_escape').decode()))
+		return
+
+	if args.input:
+		with open(args.input, 'rb', buffering=0) as stream:
+			decode(stream, table, sys.stdout)
+	else:
+		decode(sys.stdin.buffer, table, sys.stdout)
+
+
+if __name__ == '__main__':
+	main()